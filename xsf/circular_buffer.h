@@ -2,8 +2,12 @@
 #define _CIRCULAR_BUFFER_H_
 
 #include <algorithm>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 
+#include "silence_scan.h"
+
 long const silence_threshold = 8;
 
 template <typename T>
@@ -11,12 +15,13 @@ class circular_buffer {
 	std::vector<T> buffer;
 	unsigned long readptr, writeptr, used, size;
 	unsigned long silence_count;
+	unsigned long silent_run;
 	T last_written[2];
 	T last_read[2];
 
 	public:
 	circular_buffer()
-	: readptr(0), writeptr(0), size(0), used(0), silence_count(0) {
+	: readptr(0), writeptr(0), size(0), used(0), silence_count(0), silent_run(0) {
 		memset(last_written, 0, sizeof(last_written));
 		memset(last_read, 0, sizeof(last_read));
 	}
@@ -35,7 +40,14 @@ class circular_buffer {
 		unsigned long max_count = size - writeptr;
 		if(max_count > size - used) max_count = size - used;
 		if(count > max_count) return false;
-		silence_count += count_silent(&buffer[0] + writeptr, &buffer[0] + writeptr + count, last_written);
+		T const* begin = &buffer[0] + writeptr;
+		T last[2] = { last_written[0], last_written[1] };
+		unsigned long silent = count_silent(begin, begin + count, last_written);
+		silence_count += silent;
+		if(silent == count)
+			silent_run += count;
+		else
+			silent_run = count_trailing_silent(begin, begin + count, last);
 		used += count;
 		writeptr = (writeptr + count) % size;
 		return true;
@@ -60,6 +72,7 @@ class circular_buffer {
 	}
 	void reset() {
 		readptr = writeptr = used = 0;
+		silence_count = silent_run = 0;
 		memset(last_written, 0, sizeof(last_written));
 		memset(last_read, 0, sizeof(last_read));
 	}
@@ -71,42 +84,25 @@ class circular_buffer {
 	bool test_silence() const {
 		return silence_count == used;
 	}
+	/* Length of the silent run ending at the most recently written sample,
+	 * including samples that have since been read or skipped. */
+	unsigned long silent_tail() const {
+		return silent_run;
+	}
 	void remove_leading_silence() {
-		T const* p;
 		T const* begin;
 		T const* end;
 		if(used) {
-			long delta[2];
-			p = begin = &buffer[0] + readptr;
+			begin = &buffer[0] + readptr;
 			end = &buffer[0] + (writeptr > readptr ? writeptr : size);
-			while(p < end) {
-				delta[0] = p[0] - last_read[0];
-				delta[1] = p[1] - last_read[1];
-				if(((unsigned long)(delta[0] + silence_threshold) > (unsigned long)silence_threshold * 2) ||
-				   ((unsigned long)(delta[1] + silence_threshold) > (unsigned long)silence_threshold * 2))
-					break;
-				last_read[0] += (T)delta[0];
-				last_read[1] += (T)delta[1];
-				p += 2;
-			}
-			unsigned long skipped = p - begin;
+			unsigned long skipped = skip_silent(begin, end, last_read) - begin;
 			silence_count -= skipped;
 			used -= skipped;
 			readptr = (readptr + skipped) % size;
 			if(readptr == 0 && readptr != writeptr) {
-				p = begin = &buffer[0];
+				begin = &buffer[0];
 				end = &buffer[0] + writeptr;
-				while(p < end) {
-					delta[0] = p[0] - last_read[0];
-					delta[1] = p[1] - last_read[1];
-					if(((unsigned long)(delta[0] + silence_threshold) > (unsigned long)silence_threshold * 2) ||
-					   ((unsigned long)(delta[1] + silence_threshold) > (unsigned long)silence_threshold * 2))
-						break;
-					last_read[0] += (T)delta[0];
-					last_read[1] += (T)delta[1];
-					p += 2;
-				}
-				skipped = p - begin;
+				skipped = skip_silent(begin, end, last_read) - begin;
 				silence_count -= skipped;
 				used -= skipped;
 				readptr += skipped;
@@ -116,6 +112,8 @@ class circular_buffer {
 
 	private:
 	static unsigned long count_silent(T const* begin, T const* end, T* last) {
+		if constexpr(std::is_same<T, int16_t>::value)
+			return Fooyin::XSFInput::silence_count_s16(begin, end, last, silence_threshold);
 		unsigned long count = 0;
 		T const* p = begin;
 		long delta[2];
@@ -131,6 +129,38 @@ class circular_buffer {
 		}
 		return count;
 	}
+	/* Walks back from end; only called when [begin, end) has a loud frame */
+	static unsigned long count_trailing_silent(T const* begin, T const* end, T const* last) {
+		T const* p = end;
+		long delta[2];
+		while(p > begin) {
+			T const* prev = (p - 2 > begin) ? p - 4 : last;
+			delta[0] = p[-2] - prev[0];
+			delta[1] = p[-1] - prev[1];
+			if(((unsigned long)(delta[0] + silence_threshold) > (unsigned long)silence_threshold * 2) &&
+			   ((unsigned long)(delta[1] + silence_threshold) > (unsigned long)silence_threshold * 2))
+				break;
+			p -= 2;
+		}
+		return end - p;
+	}
+	static T const* skip_silent(T const* begin, T const* end, T* last) {
+		if constexpr(std::is_same<T, int16_t>::value)
+			return Fooyin::XSFInput::silence_skip_s16(begin, end, last, silence_threshold);
+		T const* p = begin;
+		long delta[2];
+		while(p < end) {
+			delta[0] = p[0] - last[0];
+			delta[1] = p[1] - last[1];
+			if(((unsigned long)(delta[0] + silence_threshold) > (unsigned long)silence_threshold * 2) ||
+			   ((unsigned long)(delta[1] + silence_threshold) > (unsigned long)silence_threshold * 2))
+				break;
+			last[0] += (T)delta[0];
+			last[1] += (T)delta[1];
+			p += 2;
+		}
+		return p;
+	}
 };
 
 #endif
@@ -0,0 +1,320 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "psf2vfs.h"
+
+#include "psfinflate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <strings.h>
+#include <unordered_map>
+
+using Fooyin::XSFInput::psf_section;
+using Fooyin::XSFInput::psf_section_ref;
+
+namespace {
+/* Memory cap for decompressed blocks, shared by every PSF2 track */
+constexpr size_t BlockCacheLimit = 32 * 1024 * 1024;
+
+/* Guards against directories which refer back to themselves */
+constexpr int MaxDirectoryDepth = 16;
+
+constexpr uint32_t DirectoryEntrySize = 48;
+constexpr uint32_t NameSize = 36;
+
+inline unsigned get_le32( void const* p )
+{
+    return  (unsigned) ((unsigned char const*) p) [3] << 24 |
+            (unsigned) ((unsigned char const*) p) [2] << 16 |
+            (unsigned) ((unsigned char const*) p) [1] <<  8 |
+            (unsigned) ((unsigned char const*) p) [0];
+}
+
+using block_data = std::shared_ptr<const std::vector<uint8_t>>;
+
+struct block_key
+{
+    const psf_section* source;
+    uint32_t offset;
+
+    bool operator==(const block_key& other) const
+    {
+        return source == other.source && offset == other.offset;
+    }
+};
+
+struct block_key_hash
+{
+    size_t operator()(const block_key& key) const
+    {
+        return std::hash<const void*>()(key.source) ^ (std::hash<uint32_t>()(key.offset) * 0x9e3779b9u);
+    }
+};
+
+/* Decompressed blocks, keyed by section and block offset. Each entry also
+ * holds its section, so a key can never be reused by another section
+ * while the entry exists. */
+class psf2_block_cache
+{
+public:
+    block_data find(const block_key& key)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_entries.find(key);
+        if(it == m_entries.end()) {
+            return {};
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->data;
+    }
+
+    void insert(const block_key& key, psf_section_ref source, block_data data)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if(m_entries.count(key)) {
+            return;
+        }
+
+        m_used += data->size();
+        m_lru.push_front({key, std::move(source), std::move(data)});
+        m_entries.emplace(key, m_lru.begin());
+
+        while(m_used > BlockCacheLimit && m_lru.size() > 1) {
+            const cache_entry& oldest = m_lru.back();
+            m_used -= oldest.data->size();
+            m_entries.erase(oldest.key);
+            m_lru.pop_back();
+        }
+    }
+
+private:
+    struct cache_entry
+    {
+        block_key key;
+        psf_section_ref source;
+        block_data data;
+    };
+
+    std::mutex m_lock;
+    std::list<cache_entry> m_lru;
+    std::unordered_map<block_key, std::list<cache_entry>::iterator, block_key_hash> m_entries;
+    size_t m_used{0};
+};
+
+psf2_block_cache& block_cache()
+{
+    static psf2_block_cache cache;
+    return cache;
+}
+} // namespace
+
+namespace Fooyin::XSFInput {
+bool psf2_vfs::add(const psf_section_ref& section)
+{
+    std::vector<entry> entries;
+    if(!parseDirectory(section, 0, 0, entries)) {
+        return false;
+    }
+
+    merge(m_root, entries);
+    return true;
+}
+
+bool psf2_vfs::parseDirectory(const psf_section_ref& section, uint32_t offset, int depth, std::vector<entry>& entries)
+{
+    const std::vector<uint8_t>& reserved = section->reserved;
+    const size_t reservedSize = reserved.size();
+
+    if(depth > MaxDirectoryDepth) {
+        return false;
+    }
+    /* A PSF2 without a filesystem, such as a bare library, is valid */
+    if(!depth && reservedSize == 0) {
+        return true;
+    }
+    if(reservedSize < 4 || offset > reservedSize - 4) {
+        return false;
+    }
+
+    const uint32_t count = get_le32(reserved.data() + offset);
+    offset += 4;
+    if(count > (reservedSize - offset) / DirectoryEntrySize) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < count; ++i, offset += DirectoryEntrySize) {
+        const uint8_t* record = reserved.data() + offset;
+
+        entry item;
+        item.name.assign((const char*)record, strnlen((const char*)record, NameSize));
+
+        const uint32_t dataOffset = get_le32(record + NameSize);
+        const uint32_t size       = get_le32(record + NameSize + 4);
+        const uint32_t blockSize  = get_le32(record + NameSize + 8);
+
+        if(!size && !blockSize) {
+            item.directory = true;
+            if(dataOffset && !parseDirectory(section, dataOffset, depth + 1, item.children)) {
+                return false;
+            }
+        }
+        else {
+            if(!blockSize) {
+                return false;
+            }
+
+            const uint32_t blockCount = size / blockSize + (size % blockSize ? 1 : 0);
+            if(dataOffset > reservedSize || blockCount > (reservedSize - dataOffset) / 4) {
+                return false;
+            }
+
+            item.source    = section;
+            item.size      = size;
+            item.blockSize = blockSize;
+            item.blocks.reserve(blockCount);
+
+            size_t blockOffset = dataOffset + (size_t)blockCount * 4;
+            for(uint32_t n = 0; n < blockCount; ++n) {
+                const uint32_t compressed = get_le32(reserved.data() + dataOffset + n * 4);
+                if(compressed > reservedSize - blockOffset) {
+                    return false;
+                }
+                item.blocks.push_back({(uint32_t)blockOffset, compressed});
+                blockOffset += compressed;
+            }
+        }
+
+        entries.push_back(std::move(item));
+    }
+
+    return true;
+}
+
+void psf2_vfs::merge(std::vector<entry>& into, std::vector<entry>& from)
+{
+    for(entry& item : from) {
+        auto existing = std::find_if(into.begin(), into.end(), [&item](const entry& other) {
+            return !strcasecmp(other.name.c_str(), item.name.c_str());
+        });
+
+        if(existing == into.end()) {
+            into.push_back(std::move(item));
+        }
+        else if(existing->directory && item.directory) {
+            merge(existing->children, item.children);
+        }
+        else {
+            *existing = std::move(item);
+        }
+    }
+}
+
+const psf2_vfs::entry* psf2_vfs::find(const char* path) const
+{
+    /* Device prefixes such as "host0:" are not part of the filesystem */
+    if(const char* colon = strrchr(path, ':')) {
+        path = colon + 1;
+    }
+
+    const std::vector<entry>* directory = &m_root;
+    const entry* found                  = nullptr;
+
+    while(*path) {
+        const size_t length = strcspn(path, "/\\");
+        if(length) {
+            if(!directory) {
+                return nullptr;
+            }
+
+            found = nullptr;
+            for(const entry& item : *directory) {
+                if(item.name.size() == length && !strncasecmp(item.name.c_str(), path, length)) {
+                    found = &item;
+                    break;
+                }
+            }
+            if(!found) {
+                return nullptr;
+            }
+            directory = found->directory ? &found->children : nullptr;
+        }
+
+        path += length;
+        if(*path) {
+            ++path;
+        }
+    }
+
+    return found;
+}
+
+int psf2_vfs::read(const char* path, int offset, char* buffer, int length) const
+{
+    if(!path || offset < 0 || length < 0 || (length && !buffer)) {
+        return -1;
+    }
+
+    const entry* file = find(path);
+    if(!file || file->directory) {
+        return -1;
+    }
+
+    if(!length) {
+        return (int)file->size;
+    }
+    if((uint32_t)offset >= file->size) {
+        return 0;
+    }
+    if((uint32_t)length > file->size - (uint32_t)offset) {
+        length = (int)(file->size - (uint32_t)offset);
+    }
+
+    int done = 0;
+    while(done < length) {
+        const uint32_t index  = (uint32_t)offset / file->blockSize;
+        const uint32_t within = (uint32_t)offset % file->blockSize;
+        const block& source   = file->blocks[index];
+
+        const block_key key{file->source.get(), source.offset};
+        block_data data = block_cache().find(key);
+        if(!data) {
+            const uint32_t start = index * file->blockSize;
+            auto inflated = std::make_shared<std::vector<uint8_t>>(std::min(file->blockSize, file->size - start));
+
+            psf_inflate_stream stream(file->source->reserved.data() + source.offset, source.size);
+            if(!stream.read(inflated->data(), inflated->size())) {
+                return -1;
+            }
+
+            block_cache().insert(key, file->source, inflated);
+            data = std::move(inflated);
+        }
+
+        const int count = (int)std::min<uint32_t>(file->blockSize - within, (uint32_t)(length - done));
+        memcpy(buffer + done, data->data() + within, count);
+        done += count;
+        offset += count;
+    }
+
+    return done;
+}
+} // namespace Fooyin::XSFInput
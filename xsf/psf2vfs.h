@@ -0,0 +1,71 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "psfcache.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+/* Read-only view of the virtual filesystem carried in the reserved areas
+ * of a PSF2 chain, in place of psflib's psf2fs. Files point straight into
+ * the shared sections, and decompressed blocks go through a process-wide
+ * LRU cache, so re-initializing a track, or playing another one from the
+ * same set, does not inflate the same blocks again. */
+class psf2_vfs
+{
+public:
+    /* Merges the filesystem of one section over those added before it, so
+     * files of a later section replace ones of the same name. */
+    bool add(const psf_section_ref& section);
+
+    /* Same contract as psf2fs_virtual_readfile: reads up to length bytes
+     * from offset, returns the file size when length is 0, or -1 if the
+     * file does not exist or cannot be decompressed. Thread safe. */
+    int read(const char* path, int offset, char* buffer, int length) const;
+
+private:
+    struct block
+    {
+        uint32_t offset; // into the reserved area
+        uint32_t size;   // compressed
+    };
+
+    struct entry
+    {
+        std::string name;
+        bool directory{false};
+        std::vector<entry> children;
+
+        psf_section_ref source;
+        uint32_t size{0};
+        uint32_t blockSize{0};
+        std::vector<block> blocks;
+    };
+
+    bool parseDirectory(const psf_section_ref& section, uint32_t offset, int depth, std::vector<entry>& entries);
+    static void merge(std::vector<entry>& into, std::vector<entry>& from);
+    [[nodiscard]] const entry* find(const char* path) const;
+
+    std::vector<entry> m_root;
+};
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,384 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "psfcache.h"
+
+#include "psfinflate.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <strings.h>
+#include <unordered_map>
+
+
+using Fooyin::XSFInput::psf_mapped_file;
+using Fooyin::XSFInput::psf_section;
+using Fooyin::XSFInput::psf_section_ref;
+
+namespace {
+/* Memory cap for sections kept alive by the cache itself. Sections still
+ * referenced by a decoder stay alive past eviction. */
+constexpr size_t SectionCacheLimit = 128 * 1024 * 1024;
+
+/* Same limit psflib applies to _lib recursion */
+constexpr int MaxLibDepth = 10;
+
+inline unsigned get_le32( void const* p )
+{
+    return  (unsigned) ((unsigned char const*) p) [3] << 24 |
+            (unsigned) ((unsigned char const*) p) [2] << 16 |
+            (unsigned) ((unsigned char const*) p) [1] <<  8 |
+            (unsigned) ((unsigned char const*) p) [0];
+}
+
+class psf_section_cache
+{
+public:
+    psf_section_ref find(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_entries.find(key);
+        if(it == m_entries.end()) {
+            return {};
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return *it->second;
+    }
+
+    psf_section_ref insert(psf_section_ref section)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_entries.find(section->key);
+        if(it != m_entries.end()) {
+            /* Another decoder loaded the same file meanwhile; share theirs */
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return *it->second;
+        }
+
+        m_lru.push_front(section);
+        m_entries.emplace(section->key, m_lru.begin());
+        m_used += section->memory();
+
+        while(m_used > SectionCacheLimit && m_lru.size() > 1) {
+            const psf_section_ref& oldest = m_lru.back();
+            m_used -= oldest->memory();
+            m_entries.erase(oldest->key);
+            m_lru.pop_back();
+        }
+
+        return section;
+    }
+
+private:
+    std::mutex m_lock;
+    std::list<psf_section_ref> m_lru;
+    std::unordered_map<std::string, std::list<psf_section_ref>::iterator> m_entries;
+    size_t m_used{0};
+};
+
+psf_section_cache& section_cache()
+{
+    static psf_section_cache cache;
+    return cache;
+}
+
+struct psf_chain_state
+{
+    uint8_t allowed_version;
+    std::vector<psf_section_ref>* sections;
+    psf_info_callback info_target;
+    void* info_context;
+    int info_want_nested_tags;
+    psf_status_callback status_target;
+    void* status_context;
+};
+
+static void chain_error( psf_chain_state * state, const char * message, const std::string & path )
+{
+    if ( state->status_target )
+    {
+        std::string text = message;
+        text += ": ";
+        text += path;
+        text += "\n";
+        state->status_target( state->status_context, text.c_str() );
+    }
+}
+
+static psf_section_ref build_section( psf_chain_state * state, const std::string & key, const std::string & path )
+{
+    psf_mapped_file map;
+    std::vector<uint8_t> buffer;
+    const uint8_t * data;
+    size_t size;
+
+    if ( map.open( path.c_str() ) )
+    {
+        data = map.data();
+        size = map.size();
+    }
+    else
+    {
+        FILE * f = fopen( path.c_str(), "rb" );
+        if ( !f )
+        {
+            chain_error( state, "Unable to open file", path );
+            return {};
+        }
+        fseek( f, 0, SEEK_END );
+        long length = ftell( f );
+        fseek( f, 0, SEEK_SET );
+        if ( length > 0 )
+        {
+            buffer.resize( length );
+            if ( fread( buffer.data(), 1, length, f ) < (size_t) length )
+                buffer.clear();
+        }
+        fclose( f );
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+    if ( size < 16 || memcmp( data, "PSF", 3 ) )
+    {
+        chain_error( state, "Not a PSF file", path );
+        return {};
+    }
+
+    size_t reserved_size = get_le32( data + 4 );
+    size_t program_size = get_le32( data + 8 );
+    uint32_t program_crc = get_le32( data + 12 );
+
+    if ( reserved_size > size - 16 || program_size > size - 16 - reserved_size )
+    {
+        chain_error( state, "Truncated PSF file", path );
+        return {};
+    }
+
+    auto section = std::make_shared<psf_section>();
+    section->key = key;
+    section->path = path;
+    section->version = data[3];
+
+    const uint8_t * reserved = data + 16;
+    section->reserved.assign( reserved, reserved + reserved_size );
+
+    const uint8_t * program = reserved + reserved_size;
+    if ( program_size )
+    {
+        if ( Fooyin::XSFInput::psf_crc32( program, program_size ) != program_crc )
+        {
+            chain_error( state, "CRC failure", path );
+            return {};
+        }
+        if ( !Fooyin::XSFInput::psf_inflate( program, program_size, section->program ) )
+        {
+            chain_error( state, "Decompression failure", path );
+            return {};
+        }
+    }
+
+    const uint8_t * tags = program + program_size;
+    size_t tags_size = size - 16 - reserved_size - program_size;
+    if ( tags_size > 5 && !memcmp( tags, "[TAG]", 5 ) )
+        Fooyin::XSFInput::psf_parse_tags( (const char *) tags + 5, tags_size - 5, section->tags );
+
+    return section;
+}
+
+static psf_section_ref get_section( psf_chain_state * state, const std::string & uri )
+{
+    std::error_code ec;
+    const std::filesystem::path canonical = std::filesystem::canonical( uri, ec );
+    if ( ec )
+    {
+        chain_error( state, "Unable to open file", uri );
+        return {};
+    }
+    std::string path = canonical.string();
+
+    const auto mtime = std::filesystem::last_write_time( canonical, ec );
+    const uintmax_t size = ec ? 0 : std::filesystem::file_size( canonical, ec );
+    if ( ec )
+    {
+        chain_error( state, "Unable to open file", path );
+        return {};
+    }
+
+    std::string key = path;
+    key += '\n';
+    key += std::to_string( (long long) mtime.time_since_epoch().count() );
+    key += '\n';
+    key += std::to_string( (unsigned long long) size );
+
+    psf_section_ref section = section_cache().find( key );
+    if ( section )
+        return section;
+
+    section = build_section( state, key, path );
+    if ( !section )
+        return {};
+
+    return section_cache().insert( std::move( section ) );
+}
+
+static const std::string * find_tag( const psf_section & section, const char * name )
+{
+    for ( const auto & tag : section.tags )
+    {
+        if ( !strcasecmp( tag.first.c_str(), name ) )
+            return &tag.second;
+    }
+    return NULL;
+}
+
+static std::string lib_path( const std::string & base, const std::string & name )
+{
+    size_t separator = base.find_last_of( Fooyin::XSFInput::psf_file_system.path_separators );
+    if ( separator == std::string::npos )
+        return name;
+    return base.substr( 0, separator + 1 ) + name;
+}
+
+static int load_chain( psf_chain_state * state, const std::string & uri, int depth )
+{
+    if ( depth > MaxLibDepth )
+    {
+        chain_error( state, "Recursion limit reached", uri );
+        return -1;
+    }
+
+    psf_section_ref section = get_section( state, uri );
+    if ( !section )
+        return -1;
+
+    if ( state->allowed_version && section->version != state->allowed_version )
+    {
+        chain_error( state, "Wrong PSF version", section->path );
+        return -1;
+    }
+    /* Libraries must match the version of the file which references them */
+    if ( !state->allowed_version )
+        state->allowed_version = section->version;
+
+    if ( state->info_target && ( !depth || state->info_want_nested_tags ) )
+    {
+        for ( const auto & tag : section->tags )
+        {
+            if ( state->info_target( state->info_context, tag.first.c_str(), tag.second.c_str() ) )
+                return -1;
+        }
+    }
+
+    /* Libraries sit next to the file as it was named, like psflib finds
+     * them; a symlink's target directory is not searched. The canonical
+     * path only keys the cache. */
+    const std::string * lib = find_tag( *section, "_lib" );
+    if ( lib && load_chain( state, lib_path( uri, *lib ), depth + 1 ) < 0 )
+        return -1;
+
+    state->sections->push_back( section );
+
+    for ( unsigned n = 2; ; ++n )
+    {
+        char name[16];
+        snprintf( name, sizeof(name), "_lib%u", n );
+        lib = find_tag( *section, name );
+        if ( !lib )
+            break;
+        if ( load_chain( state, lib_path( uri, *lib ), depth + 1 ) < 0 )
+            return -1;
+    }
+
+    return 0;
+}
+} // namespace
+
+namespace Fooyin::XSFInput {
+size_t psf_section::memory() const
+{
+    size_t total = sizeof(*this) + key.size() + path.size() + reserved.size() + program.size();
+    for(const auto& tag : tags) {
+        total += tag.first.size() + tag.second.size();
+    }
+    return total;
+}
+
+int psf_load_sections(const char* uri, uint8_t allowed_version, std::vector<psf_section_ref>& sections,
+                      psf_info_callback info_target, void* info_context, int info_want_nested_tags,
+                      psf_status_callback status_target, void* status_context)
+{
+    psf_chain_state state;
+    state.allowed_version = allowed_version;
+    state.sections = &sections;
+    state.info_target = info_target;
+    state.info_context = info_context;
+    state.info_want_nested_tags = info_want_nested_tags;
+    state.status_target = status_target;
+    state.status_context = status_context;
+
+    sections.clear();
+
+    if(load_chain(&state, uri, 0) < 0) {
+        sections.clear();
+        return -1;
+    }
+
+    return state.allowed_version;
+}
+
+int psf_feed_sections(const std::vector<psf_section_ref>& sections, psf_load_callback load_target, void* load_context,
+                      psf_status_callback status_target, void* status_context)
+{
+    for(const auto& section : sections) {
+        if(load_target(load_context, section->program.data(), section->program.size(), section->reserved.data(),
+                       section->reserved.size())) {
+            if(status_target) {
+                status_target(status_context, "Invalid format\n");
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int psf_load_cached(const char* uri, uint8_t allowed_version, psf_load_callback load_target, void* load_context,
+                    psf_info_callback info_target, void* info_context, int info_want_nested_tags,
+                    psf_status_callback status_target, void* status_context)
+{
+    std::vector<psf_section_ref> sections;
+
+    int version = psf_load_sections(uri, allowed_version, sections, info_target, info_context, info_want_nested_tags,
+                                    status_target, status_context);
+    if(version < 0) {
+        return version;
+    }
+
+    if(load_target && psf_feed_sections(sections, load_target, load_context, status_target, status_context) < 0) {
+        return -1;
+    }
+
+    return version;
+}
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,62 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "psffile.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+/* One file of a PSF chain, with its program section already inflated and
+ * CRC checked. Sections are immutable once built, and are shared between
+ * every decoder which loads the same file. */
+struct psf_section
+{
+    std::string key;  // canonical path, mtime and size
+    std::string path; // canonical path
+    uint8_t version;
+    std::vector<uint8_t> reserved;
+    std::vector<uint8_t> program;
+    psf_tag_list tags;
+
+    [[nodiscard]] size_t memory() const;
+};
+
+using psf_section_ref = std::shared_ptr<const psf_section>;
+
+/* Resolves uri and its _lib chain through the process-wide section cache.
+ * On success, sections holds the chain in the order psf_load would pass it
+ * to a load callback, and the PSF version is returned. Tags are passed to
+ * the info callback before any section is returned. */
+int psf_load_sections(const char* uri, uint8_t allowed_version, std::vector<psf_section_ref>& sections,
+                      psf_info_callback info_target, void* info_context, int info_want_nested_tags,
+                      psf_status_callback status_target, void* status_context);
+
+/* Passes each section of a resolved chain to a psflib load callback */
+int psf_feed_sections(const std::vector<psf_section_ref>& sections, psf_load_callback load_target, void* load_context,
+                      psf_status_callback status_target, void* status_context);
+
+/* Drop-in replacement for psf_load which serves the chain from the cache. */
+int psf_load_cached(const char* uri, uint8_t allowed_version, psf_load_callback load_target, void* load_context,
+                    psf_info_callback info_target, void* info_context, int info_want_nested_tags,
+                    psf_status_callback status_target, void* status_context);
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,491 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "psffile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Fooyin::XSFInput {
+#ifndef _WIN32
+/* Smaller files are read with stdio. Those are the minipsfs that tag
+ * editors rewrite in place; a mapped file truncated under the reader
+ * raises SIGBUS instead of a read error, and copying them costs little. */
+constexpr off_t MapMinSize = 1024 * 1024;
+#endif
+
+psf_mapped_file::psf_mapped_file()
+    : m_data{nullptr}
+    , m_size{0}
+{ }
+
+psf_mapped_file::~psf_mapped_file()
+{
+    close();
+}
+
+bool psf_mapped_file::open(const char* path)
+{
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < MapMinSize) {
+        ::close(fd);
+        return false;
+    }
+
+    /* psflib reads every file it opens from start to end, so fault it all
+     * in now. A file that shrank in the meantime is left to stdio. */
+#ifdef MAP_POPULATE
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+#else
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+#endif
+    struct stat after;
+    const bool resized = fstat(fd, &after) < 0 || after.st_size != st.st_size;
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+    if(resized) {
+        munmap(data, (size_t)st.st_size);
+        return false;
+    }
+
+#ifndef MAP_POPULATE
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)st.st_size;
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+void psf_mapped_file::close()
+{
+#ifndef _WIN32
+    if(m_data) {
+        munmap((void*)m_data, m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+#ifndef _WIN32
+static size_t sparse_length(size_t size)
+{
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+#endif
+
+uint8_t* psf_sparse_alloc(size_t size)
+{
+    if(!size) {
+        return nullptr;
+    }
+
+#ifndef _WIN32
+    /* Fresh anonymous pages read as zero, so there is nothing to clear */
+    void* data = mmap(nullptr, sparse_length(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1, 0);
+    if(data == MAP_FAILED) {
+        return nullptr;
+    }
+    return (uint8_t*)data;
+#else
+    return (uint8_t*)calloc(1, size);
+#endif
+}
+
+uint8_t* psf_sparse_grow(uint8_t* data, size_t old_size, size_t new_size)
+{
+    if(!data) {
+        return psf_sparse_alloc(new_size);
+    }
+    if(new_size <= old_size) {
+        return data;
+    }
+
+#ifndef _WIN32
+    const size_t old_length = sparse_length(old_size);
+    const size_t new_length = sparse_length(new_size);
+
+    /* The tail of the last page is still zero; nothing past old_size was written */
+    if(new_length == old_length) {
+        return data;
+    }
+
+#ifdef __linux__
+    void* moved = mremap(data, old_length, new_length, MREMAP_MAYMOVE);
+    if(moved == MAP_FAILED) {
+        psf_sparse_free(data, old_size);
+        return nullptr;
+    }
+    return (uint8_t*)moved;
+#else
+    uint8_t* grown = psf_sparse_alloc(new_size);
+    if(grown) {
+        memcpy(grown, data, old_size);
+    }
+    psf_sparse_free(data, old_size);
+    return grown;
+#endif
+#else
+    uint8_t* grown = (uint8_t*)realloc(data, new_size);
+    if(!grown) {
+        free(data);
+        return nullptr;
+    }
+    memset(grown + old_size, 0, new_size - old_size);
+    return grown;
+#endif
+}
+
+void psf_sparse_free(uint8_t* data, size_t size)
+{
+    if(!data) {
+        return;
+    }
+
+#ifndef _WIN32
+    munmap(data, sparse_length(size));
+#else
+    (void)size;
+    free(data);
+#endif
+}
+} // namespace Fooyin::XSFInput
+
+namespace {
+using Fooyin::XSFInput::psf_mapped_file;
+
+struct psf_file_handle
+{
+    psf_mapped_file map;
+    FILE * fp;
+    int64_t pos;
+};
+
+static void * psf_file_fopen( void *context, const char * uri )
+{
+    (void)context;
+
+    psf_file_handle * handle = new psf_file_handle;
+    handle->fp = NULL;
+    handle->pos = 0;
+
+    if ( !handle->map.open( uri ) )
+    {
+        handle->fp = fopen( uri, "rb" );
+        if ( !handle->fp )
+        {
+            delete handle;
+            return NULL;
+        }
+    }
+
+    return handle;
+}
+
+static size_t psf_file_fread( void * buffer, size_t size, size_t count, void * _handle )
+{
+    psf_file_handle * handle = ( psf_file_handle * ) _handle;
+
+    if ( handle->fp )
+        return fread( buffer, size, count, handle->fp );
+
+    if ( !size || handle->pos >= (int64_t)handle->map.size() )
+        return 0;
+
+    size_t avail = handle->map.size() - (size_t)handle->pos;
+    if ( count > avail / size )
+        count = avail / size;
+
+    memcpy( buffer, handle->map.data() + handle->pos, size * count );
+    handle->pos += size * count;
+
+    return count;
+}
+
+static int psf_file_fseek( void * _handle, int64_t offset, int whence )
+{
+    psf_file_handle * handle = ( psf_file_handle * ) _handle;
+
+    if ( handle->fp )
+        return fseek( handle->fp, offset, whence );
+
+    switch ( whence )
+    {
+        case SEEK_SET: break;
+        case SEEK_CUR: offset += handle->pos; break;
+        case SEEK_END: offset += (int64_t)handle->map.size(); break;
+        default: return -1;
+    }
+
+    if ( offset < 0 )
+        return -1;
+
+    handle->pos = offset;
+    return 0;
+}
+
+static int psf_file_fclose( void * _handle )
+{
+    psf_file_handle * handle = ( psf_file_handle * ) _handle;
+
+    if ( handle->fp )
+        fclose( handle->fp );
+
+    delete handle;
+    return 0;
+}
+
+static long psf_file_ftell( void * _handle )
+{
+    psf_file_handle * handle = ( psf_file_handle * ) _handle;
+
+    if ( handle->fp )
+        return ftell( handle->fp );
+
+    return (long)handle->pos;
+}
+
+inline unsigned get_le32( void const* p )
+{
+    return  (unsigned) ((unsigned char const*) p) [3] << 24 |
+            (unsigned) ((unsigned char const*) p) [2] << 16 |
+            (unsigned) ((unsigned char const*) p) [1] <<  8 |
+            (unsigned) ((unsigned char const*) p) [0];
+}
+
+/* Tag areas are limited to 50000 bytes by the spec; allow some slack for
+ * files which ignore that, but never read an unbounded amount. */
+constexpr long MaxTagSize = 1024 * 1024;
+
+static void trim_tag_text( const char *& begin, const char *& end )
+{
+    while ( begin < end && (unsigned char) *begin <= 0x20 ) ++begin;
+    while ( end > begin && (unsigned char) end[-1] <= 0x20 ) --end;
+}
+
+/* Splits one "name=value" line of a tag area into its trimmed halves.
+ * Returns false for lines without a name. */
+static bool split_tag_line( const char * line, const char * line_end,
+                            const char *& name_begin, const char *& name_end,
+                            const char *& value_begin, const char *& value_end )
+{
+    const char * equals = (const char *) memchr( line, '=', line_end - line );
+    if ( !equals )
+        return false;
+
+    name_begin = line;
+    name_end = equals;
+    value_begin = equals + 1;
+    value_end = line_end;
+    trim_tag_text( name_begin, name_end );
+    trim_tag_text( value_begin, value_end );
+
+    return name_begin < name_end;
+}
+} // namespace
+
+namespace Fooyin::XSFInput {
+void psf_parse_tags(const char* text, size_t size, psf_tag_list& tags)
+{
+    const char * end = text + size;
+
+    while ( text < end )
+    {
+        const char * line_end = (const char *) memchr( text, '\n', end - text );
+        if ( !line_end ) line_end = end;
+
+        const char * name_begin, * name_end, * value_begin, * value_end;
+        if ( split_tag_line( text, line_end, name_begin, name_end, value_begin, value_end ) )
+        {
+            std::string name( name_begin, name_end );
+            std::string value( value_begin, value_end );
+
+            /* Repeated variables are joined into one multi-line value */
+            bool merged = false;
+            for ( auto & tag : tags )
+            {
+                if ( !strcasecmp( tag.first.c_str(), name.c_str() ) )
+                {
+                    tag.second += '\n';
+                    tag.second += value;
+                    merged = true;
+                    break;
+                }
+            }
+            if ( !merged )
+                tags.emplace_back( std::move( name ), std::move( value ) );
+        }
+
+        text = line_end + 1;
+    }
+}
+
+int psf_read_tag_arena(const char* path, psf_tag_arena& arena)
+{
+    arena.text.clear();
+    arena.tags.clear();
+
+    /* Plain reads: mapping the file would fault in the whole program
+     * section just to get at the tags at its end */
+    FILE * f = fopen( path, "rb" );
+    if ( !f )
+        return -1;
+
+    uint8_t header[16];
+    if ( fread( header, 1, 16, f ) < 16 || memcmp( header, "PSF", 3 ) )
+    {
+        fclose( f );
+        return -1;
+    }
+
+    int version = header[3];
+    int64_t tag_offset = 16 + (int64_t) get_le32( header + 4 ) + (int64_t) get_le32( header + 8 );
+
+    if ( fseek( f, 0, SEEK_END ) < 0 )
+    {
+        fclose( f );
+        return -1;
+    }
+
+    long file_size = ftell( f );
+    if ( file_size < tag_offset )
+    {
+        fclose( f );
+        return -1;
+    }
+
+    long tag_size = file_size - (long) tag_offset;
+    if ( tag_size > MaxTagSize )
+        tag_size = MaxTagSize;
+
+    std::vector<char> & text = arena.text;
+    if ( tag_size > 5 )
+    {
+        /* One spare byte, so the last value can be terminated in place */
+        text.resize( tag_size + 1 );
+        if ( fseek( f, (long) tag_offset, SEEK_SET ) < 0 ||
+             fread( text.data(), 1, tag_size, f ) < (size_t) tag_size )
+            text.clear();
+    }
+
+    fclose( f );
+
+    if ( text.size() <= 6 || memcmp( text.data(), "[TAG]", 5 ) )
+    {
+        text.clear();
+        return version;
+    }
+
+    /* Names and values are terminated inside the raw text, so the arena
+     * points straight at the bytes read from the file. Only repeated
+     * names, whose values are joined, append anything to it. */
+    const size_t raw_size = text.size() - 1;
+    size_t pos = 5;
+    while ( pos < raw_size )
+    {
+        char * line = text.data() + pos;
+        char * line_end = (char *) memchr( line, '\n', raw_size - pos );
+        if ( !line_end ) line_end = text.data() + raw_size;
+        pos = line_end - text.data() + 1;
+
+        const char * name_begin, * name_end, * value_begin, * value_end;
+        if ( !split_tag_line( line, line_end, name_begin, name_end, value_begin, value_end ) )
+            continue;
+
+        uint32_t name_offset = (uint32_t) ( name_begin - text.data() );
+        uint32_t value_offset = (uint32_t) ( value_begin - text.data() );
+        text[name_end - text.data()] = '\0';
+        text[value_end - text.data()] = '\0';
+
+        bool merged = false;
+        for ( auto & tag : arena.tags )
+        {
+            if ( !strcasecmp( text.data() + tag.first, text.data() + name_offset ) )
+            {
+                std::string joined = text.data() + tag.second;
+                joined += '\n';
+                joined += text.data() + value_offset;
+
+                tag.second = (uint32_t) text.size();
+                text.insert( text.end(), joined.c_str(), joined.c_str() + joined.size() + 1 );
+                merged = true;
+                break;
+            }
+        }
+        if ( !merged )
+            arena.tags.emplace_back( name_offset, value_offset );
+    }
+
+    return version;
+}
+
+int psf_read_tags(const char* path, psf_info_callback info_target, void* info_context)
+{
+    psf_tag_arena arena;
+
+    int version = psf_read_tag_arena( path, arena );
+    if ( version < 0 || !info_target )
+        return version;
+
+    for ( size_t i = 0; i < arena.size(); ++i )
+    {
+        if ( info_target( info_context, arena.name( i ), arena.value( i ) ) )
+            return -1;
+    }
+
+    return version;
+}
+
+const psf_file_callbacks psf_file_system =
+{
+    "\\/|:",
+    NULL,
+    psf_file_fopen,
+    psf_file_fread,
+    psf_file_fseek,
+    psf_file_fclose,
+    psf_file_ftell
+};
+} // namespace Fooyin::XSFInput
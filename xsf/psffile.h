@@ -0,0 +1,100 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "psflib/psflib.h"
+
+namespace Fooyin::XSFInput {
+/* Read-only view of an entire file. Files of 1 MiB and up are memory
+ * mapped where the platform allows it, so callers read straight out of
+ * the page cache; open() fails for anything else, and callers fall back
+ * to stdio. A mapped file truncated while it is being read still raises
+ * SIGBUS, so views are only held while a file is parsed. */
+class psf_mapped_file
+{
+public:
+    psf_mapped_file();
+    ~psf_mapped_file();
+
+    psf_mapped_file(const psf_mapped_file&) = delete;
+    psf_mapped_file& operator=(const psf_mapped_file&) = delete;
+
+    bool open(const char* path);
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return m_data != nullptr; }
+    [[nodiscard]] const uint8_t* data() const { return m_data; }
+    [[nodiscard]] size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+};
+
+/* Zero-filled buffers for sparse ROM maps. Where the platform allows it
+ * they are backed by anonymous memory, so only pages which are actually
+ * written get committed, and the rest read as zero without costing any
+ * memory. The size a buffer was allocated or last grown with must be
+ * passed back when growing or freeing it. Like realloc in the loaders,
+ * a failed grow frees the old buffer. */
+uint8_t* psf_sparse_alloc(size_t size);
+uint8_t* psf_sparse_grow(uint8_t* data, size_t old_size, size_t new_size);
+void psf_sparse_free(uint8_t* data, size_t size);
+
+using psf_tag_list = std::vector<std::pair<std::string, std::string>>;
+
+/* Parses the text following a "[TAG]" marker. Surrounding whitespace is
+ * trimmed, and repeated names are joined into one multi-line value. */
+void psf_parse_tags(const char* text, size_t size, psf_tag_list& tags);
+
+/* Tags of a single file, parsed into one flat buffer: every name and
+ * value is a NUL terminated string inside text, located by the offsets
+ * in tags. Filling one costs a couple of allocations, however many tags
+ * the file has. */
+struct psf_tag_arena
+{
+    std::vector<char> text;
+    std::vector<std::pair<uint32_t, uint32_t>> tags;
+
+    [[nodiscard]] size_t size() const { return tags.size(); }
+    [[nodiscard]] const char* name(size_t index) const { return text.data() + tags[index].first; }
+    [[nodiscard]] const char* value(size_t index) const { return text.data() + tags[index].second; }
+};
+
+/* Reads only the header and tag area of a single PSF file, without
+ * following _lib references, inflating or CRC checking the program
+ * section, or mapping the file. Returns the PSF version byte, or a
+ * negative value on error. */
+int psf_read_tag_arena(const char* path, psf_tag_arena& arena);
+
+/* psf_read_tag_arena, passing the tags to the info callback just as
+ * psf_load would pass them for the top level file. */
+int psf_read_tags(const char* path, psf_info_callback info_target, void* info_context);
+
+/* psflib file callbacks: memory mapped reads, with a stdio fallback for
+ * files which cannot be mapped. */
+extern const psf_file_callbacks psf_file_system;
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,133 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "psfinflate.h"
+
+#include <cstring>
+
+#ifdef XSF_USE_ZLIB_NG
+#include <zlib-ng.h>
+#define PSF_Z(name) zng_##name
+#else
+#include <zlib.h>
+#define PSF_Z(name) name
+#endif
+
+namespace Fooyin::XSFInput {
+struct psf_inflate_stream::state
+{
+#ifdef XSF_USE_ZLIB_NG
+    zng_stream stream;
+#else
+    z_stream stream;
+#endif
+    int status;
+};
+
+psf_inflate_stream::psf_inflate_stream(const uint8_t* data, size_t size)
+    : m_state{std::make_unique<state>()}
+{
+    auto& stream = m_state->stream;
+    memset(&stream, 0, sizeof(stream));
+    m_state->status = PSF_Z(inflateInit)(&stream);
+
+    stream.next_in  = (uint8_t*)data;
+    stream.avail_in = (uint32_t)size;
+}
+
+psf_inflate_stream::~psf_inflate_stream()
+{
+    PSF_Z(inflateEnd)(&m_state->stream);
+}
+
+bool psf_inflate_stream::read(uint8_t* out, size_t size)
+{
+    auto& stream = m_state->stream;
+    int& status  = m_state->status;
+
+    stream.next_out  = out;
+    stream.avail_out = (uint32_t)size;
+
+    while(stream.avail_out) {
+        /* Also covers a stream which already ended short of size */
+        if(status != Z_OK) {
+            return false;
+        }
+        status = PSF_Z(inflate)(&stream, Z_NO_FLUSH);
+        if(status == Z_BUF_ERROR) {
+            /* Input exhausted before the end of the stream */
+            return false;
+        }
+    }
+
+    return status == Z_OK || status == Z_STREAM_END;
+}
+
+size_t psf_inflate_stream::total() const
+{
+    return (size_t)m_state->stream.total_out;
+}
+
+bool psf_inflate_stream::ended() const
+{
+    return m_state->status == Z_STREAM_END;
+}
+
+bool psf_inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    psf_inflate_stream stream(data, size);
+
+    size_t guess = size * 4;
+    if(guess < 65536) {
+        guess = 65536;
+    }
+    out.resize(guess);
+
+    /* Each read fills the rest of the buffer; a short one means the
+     * stream ended there, or was corrupt */
+    size_t filled = 0;
+    while(stream.read(out.data() + filled, out.size() - filled)) {
+        filled = out.size();
+        out.resize(filled * 2);
+    }
+
+    out.resize(stream.total());
+    return stream.ended();
+}
+
+bool psf_deflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+#ifdef XSF_USE_ZLIB_NG
+    size_t packed = zng_compressBound(size);
+#else
+    uLongf packed = compressBound((uLong)size);
+#endif
+    out.resize(packed);
+    if(PSF_Z(compress2)(out.data(), &packed, data, size, Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+    out.resize(packed);
+    return true;
+}
+
+uint32_t psf_crc32(const uint8_t* data, size_t size)
+{
+    return (uint32_t)PSF_Z(crc32)(PSF_Z(crc32)(0, nullptr, 0), data, (uint32_t)size);
+}
+} // namespace Fooyin::XSFInput
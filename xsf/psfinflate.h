@@ -0,0 +1,63 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* All zlib use in the plugin goes through here, so only psfinflate.cpp
+ * includes a zlib header: zlib-ng's native API when XSF_USE_ZLIB_NG is
+ * set, stock zlib otherwise. */
+namespace Fooyin::XSFInput {
+/* Incremental inflate of a single zlib stream, so callers can decode
+ * straight into their destination instead of guessing an output size. */
+class psf_inflate_stream
+{
+public:
+    psf_inflate_stream(const uint8_t* data, size_t size);
+    ~psf_inflate_stream();
+
+    psf_inflate_stream(const psf_inflate_stream&) = delete;
+    psf_inflate_stream& operator=(const psf_inflate_stream&) = delete;
+
+    /* Inflates exactly size bytes into out. Fails on corrupt data, or if
+     * the stream ends first. */
+    bool read(uint8_t* out, size_t size);
+
+    /* Number of bytes inflated so far */
+    [[nodiscard]] size_t total() const;
+    /* True once the end of the zlib stream has been reached */
+    [[nodiscard]] bool ended() const;
+
+private:
+    struct state;
+    std::unique_ptr<state> m_state;
+};
+
+/* Inflates a whole zlib stream into out, growing it as needed */
+bool psf_inflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+/* Deflates data into out at the fastest level */
+bool psf_deflate(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+
+uint32_t psf_crc32(const uint8_t* data, size_t size);
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,256 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) && defined(__SSE2__)
+#define RESAMPLER_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define RESAMPLER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+/* Longest filter setup() accepts, in input frames */
+constexpr unsigned MaxTaps = 64;
+constexpr unsigned PhaseCount = 256;
+constexpr double KaiserBeta = 8.0;
+/* Fraction of the lower Nyquist frequency left in the passband */
+constexpr double Passband = 0.92;
+/* History is only compacted once this many consumed frames pile up */
+constexpr size_t CompactFrames = 4096;
+
+double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Taps for the output frame at fraction f past a source frame; both rows
+ * read the same source frames, and f runs over [0, 1] */
+void filter_row(float* row, unsigned count, double f, double cutoff)
+{
+    const unsigned half = count / 2;
+    const double norm = bessel_i0(KaiserBeta);
+    double sum = 0.0;
+    double taps[MaxTaps];
+    for(unsigned k = 0; k < count; ++k) {
+        const double d = (double)k - (half - 1) - f;
+        const double w = d / half;
+        const double window = std::abs(w) >= 1.0 ? 0.0 : bessel_i0(KaiserBeta * std::sqrt(1.0 - w * w)) / norm;
+        const double x = 2.0 * cutoff * d;
+        const double sinc = std::abs(x) < 1e-9 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        taps[k] = sinc * window;
+        sum += taps[k];
+    }
+    for(unsigned k = 0; k < count; ++k) {
+        row[k] = (float)(taps[k] / sum);
+    }
+}
+
+inline int16_t to_s16(float sample)
+{
+    return (int16_t)std::clamp(std::lrintf(sample), -32768L, 32767L);
+}
+
+/* Filters one stereo frame with the taps interpolated t of the way from
+ * row a to row b */
+inline void convolve(const float* a, const float* b, unsigned count, float t, const float* left, const float* right,
+                     float& outLeft, float& outRight)
+{
+#if defined(RESAMPLER_SSE2)
+    const __m128 vt = _mm_set1_ps(t);
+    __m128 accLeft  = _mm_setzero_ps();
+    __m128 accRight = _mm_setzero_ps();
+    for(unsigned k = 0; k < count; k += 4) {
+        const __m128 va = _mm_loadu_ps(a + k);
+        const __m128 tap = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + k), va), vt));
+        accLeft  = _mm_add_ps(accLeft, _mm_mul_ps(tap, _mm_loadu_ps(left + k)));
+        accRight = _mm_add_ps(accRight, _mm_mul_ps(tap, _mm_loadu_ps(right + k)));
+    }
+    /* Horizontal sums of both accumulators at once */
+    const __m128 lo = _mm_unpacklo_ps(accLeft, accRight);
+    const __m128 hi = _mm_unpackhi_ps(accLeft, accRight);
+    const __m128 sum = _mm_add_ps(lo, hi);
+    const __m128 total = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    float out[4];
+    _mm_storeu_ps(out, total);
+    outLeft  = out[0];
+    outRight = out[1];
+#elif defined(RESAMPLER_NEON)
+    const float32x4_t vt = vdupq_n_f32(t);
+    float32x4_t accLeft  = vdupq_n_f32(0.0f);
+    float32x4_t accRight = vdupq_n_f32(0.0f);
+    for(unsigned k = 0; k < count; k += 4) {
+        const float32x4_t va = vld1q_f32(a + k);
+        const float32x4_t tap = vfmaq_f32(va, vsubq_f32(vld1q_f32(b + k), va), vt);
+        accLeft  = vfmaq_f32(accLeft, tap, vld1q_f32(left + k));
+        accRight = vfmaq_f32(accRight, tap, vld1q_f32(right + k));
+    }
+    outLeft  = vaddvq_f32(accLeft);
+    outRight = vaddvq_f32(accRight);
+#else
+    float accLeft  = 0.0f;
+    float accRight = 0.0f;
+    for(unsigned k = 0; k < count; ++k) {
+        const float tap = a[k] + (b[k] - a[k]) * t;
+        accLeft += tap * left[k];
+        accRight += tap * right[k];
+    }
+    outLeft  = accLeft;
+    outRight = accRight;
+#endif
+}
+} // namespace
+
+namespace Fooyin::XSFInput {
+void polyphase_resampler::setup(unsigned in_rate, unsigned out_rate, unsigned taps)
+{
+    m_inRate  = in_rate;
+    m_outRate = out_rate;
+    m_taps    = std::clamp(taps & ~3u, 4u, MaxTaps);
+    m_filter.clear();
+
+    if(active()) {
+        const double cutoff = 0.5 * Passband * std::min(1.0, (double)out_rate / in_rate);
+        m_filter.resize((PhaseCount + 1) * m_taps);
+        for(unsigned p = 0; p <= PhaseCount; ++p) {
+            filter_row(&m_filter[p * m_taps], m_taps, (double)p / PhaseCount, cutoff);
+        }
+    }
+
+    reset();
+}
+
+void polyphase_resampler::reset()
+{
+    /* Silence before the first frame, so output starts aligned with it */
+    m_left.assign(m_taps / 2 - 1, 0.0f);
+    m_right.assign(m_taps / 2 - 1, 0.0f);
+    m_pos  = m_taps / 2 - 1;
+    m_frac = 0;
+}
+
+void polyphase_resampler::save(std::vector<uint8_t>& out) const
+{
+    const size_t start = std::min(m_pos - (m_taps / 2 - 1), m_left.size());
+    const uint64_t header[2] = {m_frac, m_pos - start};
+    const size_t at = out.size();
+    out.resize(at + sizeof(header) + (m_left.size() - start) * 2 * sizeof(float));
+    uint8_t* dst = out.data() + at;
+    memcpy(dst, header, sizeof(header));
+    dst += sizeof(header);
+    for(size_t i = start; i < m_left.size(); ++i) {
+        const float frame[2] = {m_left[i], m_right[i]};
+        memcpy(dst, frame, sizeof(frame));
+        dst += sizeof(frame);
+    }
+}
+
+bool polyphase_resampler::load(const uint8_t* data, size_t size)
+{
+    uint64_t header[2];
+    if(size < sizeof(header) || (size - sizeof(header)) % (2 * sizeof(float))) {
+        return false;
+    }
+    memcpy(header, data, sizeof(header));
+    const size_t frames = (size - sizeof(header)) / (2 * sizeof(float));
+    /* The filter's first tap sits at offset, unless all input is used up */
+    const uint64_t offset = m_taps / 2 - 1;
+    if(header[0] >= m_outRate || header[1] < offset || (frames && header[1] != offset)) {
+        return false;
+    }
+    data += sizeof(header);
+    m_left.resize(frames);
+    m_right.resize(frames);
+    for(size_t i = 0; i < frames; ++i) {
+        float frame[2];
+        memcpy(frame, data + i * sizeof(frame), sizeof(frame));
+        m_left[i]  = frame[0];
+        m_right[i] = frame[1];
+    }
+    m_frac = header[0];
+    m_pos  = (size_t)header[1];
+    return true;
+}
+
+size_t polyphase_resampler::wanted(size_t frames) const
+{
+    if(!frames) {
+        return 0;
+    }
+    const size_t last = m_pos + (size_t)((m_frac + (uint64_t)(frames - 1) * m_inRate) / m_outRate);
+    const size_t needed = last + m_taps / 2 + 1;
+    return needed > m_left.size() ? needed - m_left.size() : 0;
+}
+
+void polyphase_resampler::write(const int16_t* in, size_t frames)
+{
+    const size_t start = m_left.size();
+    m_left.resize(start + frames);
+    m_right.resize(start + frames);
+    for(size_t i = 0; i < frames; ++i) {
+        m_left[start + i]  = in[i * 2];
+        m_right[start + i] = in[i * 2 + 1];
+    }
+}
+
+size_t polyphase_resampler::read(int16_t* out, size_t frames)
+{
+    size_t done = 0;
+    while(done < frames && m_pos + m_taps / 2 < m_left.size()) {
+        if(out) {
+            const float phase = (float)((double)m_frac * PhaseCount / m_outRate);
+            const unsigned row = std::min((unsigned)phase, PhaseCount - 1);
+            const float* a = &m_filter[row * m_taps];
+            const size_t first = m_pos - (m_taps / 2 - 1);
+
+            float left;
+            float right;
+            convolve(a, a + m_taps, m_taps, phase - (float)row, &m_left[first], &m_right[first], left, right);
+            out[done * 2]     = to_s16(left);
+            out[done * 2 + 1] = to_s16(right);
+        }
+        ++done;
+
+        m_frac += m_inRate;
+        m_pos += (size_t)(m_frac / m_outRate);
+        m_frac %= m_outRate;
+    }
+
+    const size_t consumed = std::min(m_pos - (m_taps / 2 - 1), m_left.size());
+    if(consumed >= CompactFrames) {
+        m_left.erase(m_left.begin(), m_left.begin() + (ptrdiff_t)consumed);
+        m_right.erase(m_right.begin(), m_right.begin() + (ptrdiff_t)consumed);
+        m_pos -= consumed;
+    }
+
+    return done;
+}
+} // namespace Fooyin::XSFInput
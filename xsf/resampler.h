@@ -0,0 +1,71 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+/* Sample rate converter for interleaved stereo int16. The windowed sinc
+ * filter is tabulated at a fixed number of fractional offsets and linearly
+ * interpolated between them, so any pair of rates shares one small table.
+ * The source position is kept as an exact fraction of the output rate and
+ * never drifts. Input is pushed with write() and output pulled with read();
+ * output starts aligned with the first input frame. */
+class polyphase_resampler
+{
+public:
+    /* Resets; a converter with equal rates is inactive and not used.
+     * taps is the filter length in input frames, rounded down to a
+     * multiple of 4 and kept within 4 to 64. */
+    void setup(unsigned in_rate, unsigned out_rate, unsigned taps = 32);
+    void reset();
+
+    [[nodiscard]] bool active() const
+    {
+        return m_inRate != m_outRate;
+    }
+
+    /* Input frames still missing before frames of output can be read */
+    [[nodiscard]] size_t wanted(size_t frames) const;
+
+    void write(const int16_t* in, size_t frames);
+
+    /* Appends the position and the input still under or ahead of the
+     * filter, so load() resumes output exactly where it stands. load()
+     * expects setup() to have been called with the same rates and taps. */
+    void save(std::vector<uint8_t>& out) const;
+    bool load(const uint8_t* data, size_t size);
+
+    /* Returns the frames produced. out may be null to only advance. */
+    size_t read(int16_t* out, size_t frames);
+
+private:
+    unsigned m_inRate{0};
+    unsigned m_outRate{0};
+    unsigned m_taps{32};
+    std::vector<float> m_filter;
+    std::vector<float> m_left;
+    std::vector<float> m_right;
+    size_t m_pos{0};
+    uint64_t m_frac{0};
+};
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,305 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "silence_scan.h"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) && defined(__SSE2__)
+#define SILENCE_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define SILENCE_SCAN_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__)
+#define SILENCE_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+using count_fn = unsigned long (*)(const int16_t*, const int16_t*, int16_t*, int16_t);
+using skip_fn  = const int16_t* (*)(const int16_t*, const int16_t*, int16_t*, int16_t);
+
+inline bool sample_quiet(int16_t sample, int16_t last, int16_t threshold)
+{
+    long delta = (long)sample - last;
+    return (unsigned long)(delta + threshold) <= (unsigned long)threshold * 2;
+}
+
+/* The vector kernels compare each frame with the one before it by loading
+ * one frame behind, so the first frame, which compares with last, and the
+ * tail shorter than a vector both go through the scalar code. */
+
+#ifdef SILENCE_SCAN_SSE2
+/* Lanes whose delta exceeds the threshold. Saturating subtraction keeps
+ * every delta which is out of range out of range. */
+inline __m128i loud_sse2(const int16_t* p, __m128i low, __m128i high)
+{
+    __m128i delta = _mm_subs_epi16(_mm_loadu_si128((const __m128i*)p), _mm_loadu_si128((const __m128i*)(p - 2)));
+    return _mm_or_si128(_mm_cmpgt_epi16(delta, high), _mm_cmplt_epi16(delta, low));
+}
+
+unsigned long count_sse2(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    if(end - begin < 2 + 8) {
+        return Fooyin::XSFInput::silence_count_s16_scalar(begin, end, last, threshold);
+    }
+
+    unsigned long count = Fooyin::XSFInput::silence_count_s16_scalar(begin, begin + 2, last, threshold);
+
+    const __m128i high = _mm_set1_epi16(threshold);
+    const __m128i low  = _mm_set1_epi16((int16_t)-threshold);
+
+    const int16_t* p = begin + 2;
+    for(; end - p >= 8; p += 8) {
+        __m128i loud = loud_sse2(p, low, high);
+        /* A frame is only loud when both of its channels are */
+        __m128i frames = _mm_and_si128(loud, _mm_srli_epi32(loud, 16));
+        count += 2 * (4 - std::popcount((unsigned)_mm_movemask_epi8(frames) & 0x1111u));
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return count + Fooyin::XSFInput::silence_count_s16_scalar(p, end, last, threshold);
+}
+
+const int16_t* skip_sse2(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    if(end - begin < 2 + 8) {
+        return Fooyin::XSFInput::silence_skip_s16_scalar(begin, end, last, threshold);
+    }
+
+    const int16_t* p = Fooyin::XSFInput::silence_skip_s16_scalar(begin, begin + 2, last, threshold);
+    if(p == begin) {
+        return p;
+    }
+
+    const __m128i high = _mm_set1_epi16(threshold);
+    const __m128i low  = _mm_set1_epi16((int16_t)-threshold);
+
+    for(; end - p >= 8; p += 8) {
+        __m128i loud = loud_sse2(p, low, high);
+        /* Leading silence ends at a frame with either channel loud */
+        __m128i frames = _mm_or_si128(loud, _mm_srli_epi32(loud, 16));
+        unsigned mask  = (unsigned)_mm_movemask_epi8(frames) & 0x1111u;
+        if(mask) {
+            p += (std::countr_zero(mask) / 4) * 2;
+            last[0] = p[-2];
+            last[1] = p[-1];
+            return p;
+        }
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return Fooyin::XSFInput::silence_skip_s16_scalar(p, end, last, threshold);
+}
+#endif
+
+#ifdef SILENCE_SCAN_AVX2
+__attribute__((target("avx2"))) inline __m256i loud_avx2(const int16_t* p, __m256i low, __m256i high)
+{
+    __m256i delta = _mm256_subs_epi16(_mm256_loadu_si256((const __m256i*)p),
+                                      _mm256_loadu_si256((const __m256i*)(p - 2)));
+    return _mm256_or_si256(_mm256_cmpgt_epi16(delta, high), _mm256_cmpgt_epi16(low, delta));
+}
+
+__attribute__((target("avx2"))) unsigned long count_avx2(const int16_t* begin, const int16_t* end, int16_t* last,
+                                                        int16_t threshold)
+{
+    if(end - begin < 2 + 16) {
+        return count_sse2(begin, end, last, threshold);
+    }
+
+    unsigned long count = Fooyin::XSFInput::silence_count_s16_scalar(begin, begin + 2, last, threshold);
+
+    const __m256i high = _mm256_set1_epi16(threshold);
+    const __m256i low  = _mm256_set1_epi16((int16_t)-threshold);
+
+    const int16_t* p = begin + 2;
+    for(; end - p >= 16; p += 16) {
+        __m256i loud   = loud_avx2(p, low, high);
+        __m256i frames = _mm256_and_si256(loud, _mm256_srli_epi32(loud, 16));
+        count += 2 * (8 - std::popcount((unsigned)_mm256_movemask_epi8(frames) & 0x11111111u));
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return count + count_sse2(p, end, last, threshold);
+}
+
+__attribute__((target("avx2"))) const int16_t* skip_avx2(const int16_t* begin, const int16_t* end, int16_t* last,
+                                                         int16_t threshold)
+{
+    if(end - begin < 2 + 16) {
+        return skip_sse2(begin, end, last, threshold);
+    }
+
+    const int16_t* p = Fooyin::XSFInput::silence_skip_s16_scalar(begin, begin + 2, last, threshold);
+    if(p == begin) {
+        return p;
+    }
+
+    const __m256i high = _mm256_set1_epi16(threshold);
+    const __m256i low  = _mm256_set1_epi16((int16_t)-threshold);
+
+    for(; end - p >= 16; p += 16) {
+        __m256i loud   = loud_avx2(p, low, high);
+        __m256i frames = _mm256_or_si256(loud, _mm256_srli_epi32(loud, 16));
+        unsigned mask  = (unsigned)_mm256_movemask_epi8(frames) & 0x11111111u;
+        if(mask) {
+            p += (std::countr_zero(mask) / 4) * 2;
+            last[0] = p[-2];
+            last[1] = p[-1];
+            return p;
+        }
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return skip_sse2(p, end, last, threshold);
+}
+#endif
+
+#ifdef SILENCE_SCAN_NEON
+inline uint32x4_t loud_neon(const int16_t* p, int16x8_t low, int16x8_t high)
+{
+    int16x8_t delta = vqsubq_s16(vld1q_s16(p), vld1q_s16(p - 2));
+    return vreinterpretq_u32_u16(vorrq_u16(vcgtq_s16(delta, high), vcltq_s16(delta, low)));
+}
+
+unsigned long count_neon(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    if(end - begin < 2 + 8) {
+        return Fooyin::XSFInput::silence_count_s16_scalar(begin, end, last, threshold);
+    }
+
+    unsigned long count = Fooyin::XSFInput::silence_count_s16_scalar(begin, begin + 2, last, threshold);
+
+    const int16x8_t high = vdupq_n_s16(threshold);
+    const int16x8_t low  = vdupq_n_s16((int16_t)-threshold);
+
+    const int16_t* p = begin + 2;
+    for(; end - p >= 8; p += 8) {
+        uint32x4_t loud   = loud_neon(p, low, high);
+        uint32x4_t frames = vandq_u32(loud, vshrq_n_u32(loud, 16));
+        count += 2 * (4 - vaddvq_u32(vandq_u32(frames, vdupq_n_u32(1))));
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return count + Fooyin::XSFInput::silence_count_s16_scalar(p, end, last, threshold);
+}
+
+const int16_t* skip_neon(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    if(end - begin < 2 + 8) {
+        return Fooyin::XSFInput::silence_skip_s16_scalar(begin, end, last, threshold);
+    }
+
+    const int16_t* p = Fooyin::XSFInput::silence_skip_s16_scalar(begin, begin + 2, last, threshold);
+    if(p == begin) {
+        return p;
+    }
+
+    const int16x8_t high = vdupq_n_s16(threshold);
+    const int16x8_t low  = vdupq_n_s16((int16_t)-threshold);
+
+    for(; end - p >= 8; p += 8) {
+        uint32x4_t loud   = loud_neon(p, low, high);
+        uint32x4_t frames = vorrq_u32(loud, vshrq_n_u32(loud, 16));
+        if(vmaxvq_u32(frames)) {
+            /* The scalar scan stops exactly at the first loud frame */
+            break;
+        }
+    }
+
+    last[0] = p[-2];
+    last[1] = p[-1];
+    return Fooyin::XSFInput::silence_skip_s16_scalar(p, end, last, threshold);
+}
+#endif
+
+struct silence_kernels
+{
+    count_fn count;
+    skip_fn skip;
+};
+
+silence_kernels select_kernels()
+{
+#if defined(SILENCE_SCAN_AVX2)
+    if(__builtin_cpu_supports("avx2")) {
+        return {count_avx2, skip_avx2};
+    }
+#endif
+#if defined(SILENCE_SCAN_SSE2)
+    return {count_sse2, skip_sse2};
+#elif defined(SILENCE_SCAN_NEON)
+    return {count_neon, skip_neon};
+#else
+    return {Fooyin::XSFInput::silence_count_s16_scalar, Fooyin::XSFInput::silence_skip_s16_scalar};
+#endif
+}
+
+const silence_kernels& kernels()
+{
+    static const silence_kernels selected = select_kernels();
+    return selected;
+}
+} // namespace
+
+namespace Fooyin::XSFInput {
+unsigned long silence_count_s16_scalar(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    unsigned long count = 0;
+    for(const int16_t* p = begin; p < end; p += 2) {
+        if(sample_quiet(p[0], last[0], threshold) || sample_quiet(p[1], last[1], threshold)) {
+            count += 2;
+        }
+        last[0] = p[0];
+        last[1] = p[1];
+    }
+    return count;
+}
+
+const int16_t* silence_skip_s16_scalar(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    const int16_t* p = begin;
+    for(; p < end; p += 2) {
+        if(!sample_quiet(p[0], last[0], threshold) || !sample_quiet(p[1], last[1], threshold)) {
+            break;
+        }
+        last[0] = p[0];
+        last[1] = p[1];
+    }
+    return p;
+}
+
+unsigned long silence_count_s16(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    return kernels().count(begin, end, last, threshold);
+}
+
+const int16_t* silence_skip_s16(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold)
+{
+    return kernels().skip(begin, end, last, threshold);
+}
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,40 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/* Silence scanning over interleaved stereo int16 samples, as used by
+ * circular_buffer. A frame counts as silent when either channel moved by
+ * no more than threshold since the previous frame; leading silence ends at
+ * the first frame where any channel moved by more. last holds the previous
+ * frame on entry and the final frame scanned on return, so scans chain
+ * across calls. Sizes are in samples and must be even.
+ *
+ * The default entry points pick the widest kernel the CPU supports the
+ * first time they run; the scalar ones are the reference they must match.
+ */
+namespace Fooyin::XSFInput {
+unsigned long silence_count_s16(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold);
+const int16_t* silence_skip_s16(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold);
+
+unsigned long silence_count_s16_scalar(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold);
+const int16_t* silence_skip_s16_scalar(const int16_t* begin, const int16_t* end, int16_t* last, int16_t threshold);
+} // namespace Fooyin::XSFInput
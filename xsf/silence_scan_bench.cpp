@@ -0,0 +1,145 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Compares the dispatched silence kernels with the scalar reference, for
+ * results and for speed. Built with XSF_BUILD_BENCHMARKS. */
+
+#include "silence_scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace Fooyin::XSFInput;
+
+namespace {
+constexpr size_t Frames     = 1 << 16;
+constexpr int Rounds        = 2000;
+constexpr int16_t Threshold = 8;
+
+struct bench_case
+{
+    const char* name;
+    /* Largest step between frames; above Threshold some frames are loud */
+    int step;
+    /* Frames of silence before the signal starts */
+    size_t lead;
+    /* Whether the skip kernel scans most of the buffer, and is timed */
+    bool timeSkip;
+};
+
+std::vector<int16_t> make_signal(const bench_case& test)
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> step(-test.step, test.step);
+    std::vector<int16_t> samples(Frames * 2);
+    int left  = 0;
+    int right = 0;
+    for(size_t i = 0; i < Frames; ++i) {
+        if(i >= test.lead) {
+            left  = std::clamp(left + step(rng), -32768, 32767);
+            right = std::clamp(right + step(rng), -32768, 32767);
+        }
+        samples[i * 2]     = (int16_t)left;
+        samples[i * 2 + 1] = (int16_t)right;
+    }
+    return samples;
+}
+
+template <typename Fn>
+double time_rounds(Fn&& fn)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < Rounds; ++i) {
+        fn();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const char* kernel, const char* name, double scalar, double dispatched)
+{
+    const double bytes = (double)Frames * 4 * Rounds;
+    printf("%-6s %-12s scalar %8.1f MB/s  dispatched %8.1f MB/s  %5.2fx\n", kernel, name, bytes / scalar / 1e6,
+           bytes / dispatched / 1e6, scalar / dispatched);
+}
+} // namespace
+
+int main()
+{
+    const bench_case cases[] = {
+        {"quiet", Threshold, 0, true},
+        {"loud", 2000, 0, false},
+        {"mixed", Threshold * 2, 0, false},
+        {"lead-in", 2000, Frames - 1024, true},
+    };
+
+    int failures = 0;
+    for(const auto& test : cases) {
+        const std::vector<int16_t> samples = make_signal(test);
+        const int16_t* begin = samples.data();
+        const int16_t* end   = begin + samples.size();
+
+        /* Results must match before the timings mean anything */
+        int16_t lastScalar[2]     = {0, 0};
+        int16_t lastDispatched[2] = {0, 0};
+        if(silence_count_s16_scalar(begin, end, lastScalar, Threshold)
+               != silence_count_s16(begin, end, lastDispatched, Threshold)
+           || lastScalar[0] != lastDispatched[0] || lastScalar[1] != lastDispatched[1]) {
+            printf("count  %-12s MISMATCH\n", test.name);
+            ++failures;
+        }
+        int16_t skipScalar[2]     = {0, 0};
+        int16_t skipDispatched[2] = {0, 0};
+        if(silence_skip_s16_scalar(begin, end, skipScalar, Threshold)
+               != silence_skip_s16(begin, end, skipDispatched, Threshold)
+           || skipScalar[0] != skipDispatched[0] || skipScalar[1] != skipDispatched[1]) {
+            printf("skip   %-12s MISMATCH\n", test.name);
+            ++failures;
+        }
+
+        /* Accumulated so the calls cannot be optimized away */
+        volatile unsigned long sink = 0;
+        const double countScalar = time_rounds([&]() {
+            int16_t last[2] = {0, 0};
+            sink = sink + silence_count_s16_scalar(begin, end, last, Threshold);
+        });
+        const double countDispatched = time_rounds([&]() {
+            int16_t last[2] = {0, 0};
+            sink = sink + silence_count_s16(begin, end, last, Threshold);
+        });
+        report("count", test.name, countScalar, countDispatched);
+
+        if(!test.timeSkip) {
+            continue;
+        }
+        const double skipScalarTime = time_rounds([&]() {
+            int16_t last[2] = {0, 0};
+            sink = sink + (unsigned long)(silence_skip_s16_scalar(begin, end, last, Threshold) - begin);
+        });
+        const double skipDispatchedTime = time_rounds([&]() {
+            int16_t last[2] = {0, 0};
+            sink = sink + (unsigned long)(silence_skip_s16(begin, end, last, Threshold) - begin);
+        });
+        report("skip", test.name, skipScalarTime, skipDispatchedTime);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "snapshot_cache.h"
+
+#include "psfinflate.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+constexpr char SnapshotMagic[4] = {'X', 'S', 'F', 'K'};
+constexpr uint32_t SnapshotFormat = 2;
+/* Sanity limit for the table of a corrupt file */
+constexpr uint32_t MaxSnapshots = 65536;
+
+struct snapshot_header
+{
+    char magic[4];
+    uint32_t format;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct snapshot_record
+{
+    int64_t frame;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t packed;
+};
+} // namespace
+
+namespace Fooyin::XSFInput {
+bool snapshot_file::open(const std::string& path, size_t state_size)
+{
+    close();
+
+    std::error_code ec;
+    const uint64_t fileSize = std::filesystem::file_size(path, ec);
+    if(ec) {
+        return false;
+    }
+
+    std::ifstream f(path, std::ios::binary);
+    snapshot_header header;
+    std::vector<snapshot_record> records;
+    bool ok = f.read((char*)&header, sizeof(header)) && !memcmp(header.magic, SnapshotMagic, 4)
+           && header.format == SnapshotFormat && header.count <= MaxSnapshots;
+    if(ok) {
+        records.resize(header.count);
+        ok = (bool)f.read((char*)records.data(), (std::streamsize)(records.size() * sizeof(snapshot_record)));
+    }
+
+    const uint64_t tableEnd = sizeof(header) + records.size() * sizeof(snapshot_record);
+    int64_t lastFrame = -1;
+    for(size_t i = 0; ok && i < records.size(); ++i) {
+        const auto& record = records[i];
+        ok = record.size == state_size && record.offset >= tableEnd && record.offset <= fileSize
+          && record.packed <= fileSize - record.offset && record.frame > lastFrame;
+        lastFrame = record.frame;
+    }
+
+    if(!ok) {
+        return false;
+    }
+
+    for(const auto& record : records) {
+        m_entries.push_back({(long)record.frame, record.offset, record.size, record.packed});
+    }
+    m_path = path;
+
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+    return true;
+}
+
+void snapshot_file::close()
+{
+    m_path.clear();
+    m_entries.clear();
+}
+
+long snapshot_file::last_frame() const
+{
+    return m_entries.empty() ? -1 : m_entries.back().frame;
+}
+
+const snapshot_cache_entry* snapshot_file::find(long frame) const
+{
+    const snapshot_cache_entry* found = nullptr;
+    for(const auto& entry : m_entries) {
+        if(entry.frame > frame) {
+            break;
+        }
+        found = &entry;
+    }
+    return found;
+}
+
+bool snapshot_file::read(const snapshot_cache_entry& entry, std::vector<uint8_t>& state) const
+{
+    std::ifstream f(m_path, std::ios::binary);
+    if(!f) {
+        return false;
+    }
+
+    /* Sizes were checked against the file when the table was read */
+    std::vector<uint8_t> packed(entry.packed);
+    if(!f.seekg((std::streamoff)entry.offset) || !f.read((char*)packed.data(), (std::streamsize)packed.size())) {
+        return false;
+    }
+
+    state.resize(entry.size);
+    psf_inflate_stream stream(packed.data(), packed.size());
+    return stream.read(state.data(), state.size());
+}
+
+bool snapshot_file::write(const std::string& path, const std::vector<emu_snapshot>& snapshots)
+{
+    std::vector<snapshot_record> records(snapshots.size());
+    std::vector<std::vector<uint8_t>> packed(snapshots.size());
+
+    uint64_t offset = sizeof(snapshot_header) + records.size() * sizeof(snapshot_record);
+    for(size_t i = 0; i < snapshots.size(); ++i) {
+        const auto& state = snapshots[i].state;
+        if(!psf_deflate(state.data(), state.size(), packed[i])) {
+            return false;
+        }
+
+        records[i] = {snapshots[i].frame, offset, (uint32_t)state.size(), (uint32_t)packed[i].size()};
+        offset += packed[i].size();
+    }
+
+    snapshot_header header;
+    memcpy(header.magic, SnapshotMagic, 4);
+    header.format   = SnapshotFormat;
+    header.count    = (uint32_t)records.size();
+    header.reserved = 0;
+
+    const std::string temp = path + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if(!f) {
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+           && fwrite(records.data(), sizeof(snapshot_record), records.size(), f) == records.size();
+    for(size_t i = 0; ok && i < packed.size(); ++i) {
+        ok = fwrite(packed[i].data(), 1, packed[i].size(), f) == packed[i].size();
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if(!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void snapshot_cache_trim(const std::string& directory, uint64_t limit)
+{
+    struct cache_file
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uint64_t size;
+    };
+
+    std::error_code ec;
+    std::vector<cache_file> files;
+    uint64_t total = 0;
+
+    for(const auto& item : std::filesystem::directory_iterator(directory, ec)) {
+        if(!item.is_regular_file(ec)) {
+            continue;
+        }
+        const uint64_t size = item.file_size(ec);
+        if(ec) {
+            continue;
+        }
+        files.push_back({item.path(), item.last_write_time(ec), size});
+        total += size;
+    }
+
+    std::sort(files.begin(), files.end(), [](const cache_file& a, const cache_file& b) { return a.used < b.used; });
+
+    for(const auto& file : files) {
+        if(total <= limit) {
+            break;
+        }
+        if(std::filesystem::remove(file.path, ec)) {
+            total -= file.size;
+        }
+    }
+}
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,69 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "snapshot_index.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+struct snapshot_cache_entry
+{
+    long frame;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t packed;
+};
+
+/* A track's seek snapshots as stored on disk: a table of frames, followed
+ * by each state deflated on its own. Only the table is read up front;
+ * states are read back one at a time as seeks need them. The file is in
+ * host byte order, as it never leaves the machine that wrote it. */
+class snapshot_file
+{
+public:
+    /* Reads the table, and marks the file as recently used. Every state
+     * must be state_size bytes and lie within the file; any other file is
+     * rejected as corrupt or stale. */
+    bool open(const std::string& path, size_t state_size);
+    void close();
+
+    /* Frame of the last state in the file, or -1 */
+    [[nodiscard]] long last_frame() const;
+
+    /* The latest entry at or before frame, or nullptr */
+    [[nodiscard]] const snapshot_cache_entry* find(long frame) const;
+
+    bool read(const snapshot_cache_entry& entry, std::vector<uint8_t>& state) const;
+
+    /* Replaces the file at path, going through a temporary file */
+    static bool write(const std::string& path, const std::vector<emu_snapshot>& snapshots);
+
+private:
+    std::string m_path;
+    std::vector<snapshot_cache_entry> m_entries;
+};
+
+/* Deletes the least recently used files in directory until the files left
+ * take at most limit bytes */
+void snapshot_cache_trim(const std::string& directory, uint64_t limit);
+} // namespace Fooyin::XSFInput
@@ -0,0 +1,131 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+struct emu_snapshot
+{
+    long frame;
+    std::vector<uint8_t> state;
+};
+
+/* Emulator states taken every interval frames of playback, in frame order.
+ * When a new state would take the index over its byte budget, every other
+ * state is dropped and the interval doubles, so the states stay evenly
+ * spread over whatever has been played so far. */
+class snapshot_index
+{
+public:
+    void reset(size_t budget, long interval)
+    {
+        m_snapshots.clear();
+        m_budget   = budget;
+        m_base     = interval;
+        m_interval = interval;
+        m_bytes    = 0;
+    }
+
+    /* Drops the states, and the spacing that thinning them had widened */
+    void clear()
+    {
+        reset(m_budget, m_base);
+    }
+
+    [[nodiscard]] bool enabled() const
+    {
+        return m_budget > 0 && m_interval > 0;
+    }
+
+    [[nodiscard]] const std::vector<emu_snapshot>& snapshots() const
+    {
+        return m_snapshots;
+    }
+
+    /* Frame of the last state taken, or -1 */
+    [[nodiscard]] long last_frame() const
+    {
+        return m_snapshots.empty() ? -1 : m_snapshots.back().frame;
+    }
+
+    /* Whether a state taken at frame would be kept */
+    [[nodiscard]] bool due(long frame) const
+    {
+        if(!enabled()) {
+            return false;
+        }
+        if(m_snapshots.empty()) {
+            return true;
+        }
+        return frame >= m_snapshots.back().frame + m_interval;
+    }
+
+    void add(long frame, std::vector<uint8_t>&& state)
+    {
+        while(m_snapshots.size() > 1 && m_bytes + state.size() > m_budget) {
+            thin();
+        }
+        if(m_bytes + state.size() > m_budget) {
+            return;
+        }
+        m_bytes += state.size();
+        m_snapshots.push_back({frame, std::move(state)});
+    }
+
+    /* The latest state at or before frame, or nullptr */
+    [[nodiscard]] const emu_snapshot* find(long frame) const
+    {
+        const emu_snapshot* found = nullptr;
+        for(const auto& snapshot : m_snapshots) {
+            if(snapshot.frame > frame) {
+                break;
+            }
+            found = &snapshot;
+        }
+        return found;
+    }
+
+private:
+    void thin()
+    {
+        size_t kept = 0;
+        for(size_t i = 0; i < m_snapshots.size(); ++i) {
+            if(i & 1) {
+                m_bytes -= m_snapshots[i].state.size();
+            }
+            else {
+                m_snapshots[kept++] = std::move(m_snapshots[i]);
+            }
+        }
+        m_snapshots.resize(kept);
+        m_interval *= 2;
+    }
+
+    std::vector<emu_snapshot> m_snapshots;
+    size_t m_budget{0};
+    long m_base{0};
+    long m_interval{0};
+    size_t m_bytes{0};
+};
+} // namespace Fooyin::XSFInput
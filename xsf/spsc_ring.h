@@ -0,0 +1,122 @@
+/*
+ * xSF Plugin
+ * Copyright © 2025, Christopher Snowhill <kode54@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Fooyin::XSFInput {
+/* Fixed size ring for exactly one producer thread and one consumer thread.
+ * Neither side ever takes a lock: each only advances its own counter, and
+ * the counters only ever grow, so their difference is the fill level.
+ * resize() and reset() must only be called while neither side is active. */
+template <typename T>
+class spsc_ring
+{
+public:
+    void resize(size_t capacity)
+    {
+        m_buffer.assign(capacity, T{});
+        reset();
+    }
+
+    void reset()
+    {
+        m_written.store(0, std::memory_order_relaxed);
+        m_read.store(0, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] size_t capacity() const
+    {
+        return m_buffer.size();
+    }
+
+    /* Consumer side */
+    [[nodiscard]] size_t available() const
+    {
+        return (size_t)(m_written.load(std::memory_order_acquire) - m_read.load(std::memory_order_relaxed));
+    }
+
+    /* Producer side */
+    [[nodiscard]] size_t free_space() const
+    {
+        return m_buffer.size()
+             - (size_t)(m_written.load(std::memory_order_relaxed) - m_read.load(std::memory_order_acquire));
+    }
+
+    size_t write(const T* src, size_t count)
+    {
+        count = std::min(count, free_space());
+        if(!count) {
+            return 0;
+        }
+
+        const uint64_t written = m_written.load(std::memory_order_relaxed);
+        copy_in(src, (size_t)(written % m_buffer.size()), count);
+        m_written.store(written + count, std::memory_order_release);
+
+        return count;
+    }
+
+    size_t read(T* dst, size_t count)
+    {
+        count = std::min(count, available());
+        if(!count) {
+            return 0;
+        }
+
+        const uint64_t read = m_read.load(std::memory_order_relaxed);
+        copy_out(dst, (size_t)(read % m_buffer.size()), count);
+        m_read.store(read + count, std::memory_order_release);
+
+        return count;
+    }
+
+    /* Consumer side: drops up to count items without copying them */
+    size_t skip(size_t count)
+    {
+        count = std::min(count, available());
+        m_read.fetch_add(count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    void copy_in(const T* src, size_t pos, size_t count)
+    {
+        const size_t first = std::min(count, m_buffer.size() - pos);
+        std::copy(src, src + first, m_buffer.begin() + pos);
+        std::copy(src + first, src + count, m_buffer.begin());
+    }
+
+    void copy_out(T* dst, size_t pos, size_t count) const
+    {
+        const size_t first = std::min(count, m_buffer.size() - pos);
+        std::copy(m_buffer.begin() + pos, m_buffer.begin() + pos + first, dst);
+        std::copy(m_buffer.begin(), m_buffer.begin() + (count - first), dst + first);
+    }
+
+    std::vector<T> m_buffer;
+    alignas(64) std::atomic<uint64_t> m_written{0};
+    alignas(64) std::atomic<uint64_t> m_read{0};
+};
+} // namespace Fooyin::XSFInput
@@ -20,9 +20,16 @@
 #include "xsfinput.h"
 
 #include "xsfinputdefs.h"
+#include "psf2vfs.h"
+#include "psfcache.h"
+#include "psffile.h"
+#include "psfinflate.h"
  
+#include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QRegularExpression>
+#include <QStandardPaths>
 
 #include "highly_experimental/Core/psx.h"
 #include "highly_experimental/Core/iop.h"
@@ -42,6 +49,7 @@
 #include <mgba/core/blip_buf.h>
 #include <mgba-util/vfs.h>
 #include <mgba/core/log.h>
+#include <mgba/core/version.h>
 
 #include "lazyusf2/usf/usf.h"
 
@@ -51,13 +59,14 @@
 #include "sseqplayer/SDAT.h"
 
 #include "psflib/psflib.h"
-#include "psflib/psf2fs.h"
 
 #include "snes9x.h"
 
 #include "hebios.h"
 
-#include <zlib.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 # define strdup(s)							      \
   (__extension__							      \
@@ -76,10 +85,48 @@ Q_LOGGING_CATEGORY(XSF_INPUT, "fy.xsfinput")
 
 using namespace Qt::StringLiterals;
 
+using Fooyin::XSFInput::psf_inflate_stream;
+using Fooyin::XSFInput::psf_sparse_alloc;
+using Fooyin::XSFInput::psf_sparse_free;
+using Fooyin::XSFInput::psf_sparse_grow;
+
 constexpr auto BufferLen = 2048;
+/* Frames held by the silence buffer. Silence is tracked as a run length,
+ * so this only bounds how far rendering runs ahead of playback. */
+constexpr auto SilenceBufferLen = BufferLen * 4;
+/* Initial spacing of seek snapshots */
+constexpr auto SnapshotSeconds = 5;
 
 namespace {
 
+/* What each quality profile sets; balanced is what the cores always used.
+ * Only output quality changes, never emulation accuracy. */
+struct quality_profile
+{
+    const char* name;
+    int snsfInterpolation;
+    int twosfInterpolation;
+    Interpolation ncsfInterpolation;
+    unsigned resamplerTaps;
+};
+
+/* Reference only differs from balanced for 2SF, and for the formats that
+ * go through the resampler. SNSF stays on Gaussian, which is the filter
+ * the SNES DSP itself applies; snes9x's cubic and sinc modes are further
+ * from the hardware, not closer. NCSF is already on sinc, the best that
+ * sseqplayer has, and balanced keeps it so its output is unchanged. */
+const quality_profile QualitySettings[] = {
+    /* Low power: linear or no interpolation, short resampler filter */
+    {"low power", 1, 0, INTERPOLATION_LINEAR, 16},
+    /* Balanced: SNES Gaussian, NDS linear, NCSF sinc */
+    {"balanced", 2, 1, INTERPOLATION_SINC, 32},
+    /* Reference: cosine interpolation for 2SF, long resampler filter */
+    {"reference", 2, 2, INTERPOLATION_SINC, 64},
+};
+
+/* Tracks shorter than this are not worth recording a speed for */
+constexpr auto RenderSpeedSeconds = 10;
+
 static void GSFLogger(struct mLogger* logger, int category, enum mLogLevel level, const char* format, va_list args)
 {
     (void)logger;
@@ -93,15 +140,47 @@ static struct mLogger gsf_logger = {
     .log = GSFLogger,
 };
 
-static struct xsf_init {
-    xsf_init() {
+/* One-time core setup runs on first use of each core, not at plugin load,
+ * so formats which are never played cost nothing. Safe to call from any
+ * number of decoders at once.
+ */
+template <typename Init>
+static void core_init_once(std::once_flag & flag, const char * name, Init init)
+{
+    std::call_once(flag, [name, &init]() {
+        QElapsedTimer timer;
+        timer.start();
+        init();
+        qCDebug(XSF_INPUT) << name << "core initialized in" << timer.nsecsElapsed() / 1000 << "us";
+    });
+}
+
+static void psx_core_init()
+{
+    static std::once_flag flag;
+    core_init_once(flag, "PSX", []() {
         bios_set_image( hebios, HEBIOS_SIZE );
         psx_init();
-        sega_init();
-        qsound_init();
-        mLogSetDefaultLogger(&gsf_logger);
-    }
-} _xsf_init;
+    });
+}
+
+static void sega_core_init()
+{
+    static std::once_flag flag;
+    core_init_once(flag, "Sega", []() { sega_init(); });
+}
+
+static void qsound_core_init()
+{
+    static std::once_flag flag;
+    core_init_once(flag, "QSound", []() { qsound_init(); });
+}
+
+static void gsf_core_init()
+{
+    static std::once_flag flag;
+    core_init_once(flag, "GBA", []() { mLogSetDefaultLogger(&gsf_logger); });
+}
 
 inline unsigned get_be16( void const* p )
 {
@@ -179,57 +258,12 @@ static unsigned long parse_time_crap(const char *input)
     return value;
 }
 
-struct psf_tag
-{
-    char * name;
-    char * value;
-    struct psf_tag * next;
-};
-
-static struct psf_tag * add_tag( struct psf_tag * tags, const char * name, const char * value )
-{
-    struct psf_tag * tag = (struct psf_tag *) malloc( sizeof( struct psf_tag ) );
-    if ( !tag ) return tags;
-
-    tag->name = strdup( name );
-    if ( !tag->name ) {
-        free( tag );
-        return tags;
-    }
-    tag->value = strdup( value );
-    if ( !tag->value ) {
-        free( tag->name );
-        free( tag );
-        return tags;
-    }
-    tag->next = tags;
-    return tag;
-}
-
-static void free_tags( struct psf_tag * tags )
-{
-    struct psf_tag * tag, * next;
-
-    tag = tags;
-
-    while ( tag )
-    {
-        next = tag->next;
-        free( tag->name );
-        free( tag->value );
-        free( tag );
-        tag = next;
-    }
-}
-
 struct psf_info_meta_state
 {
     int tag_song_ms;
     int tag_fade_ms;
     
     bool utf8;
-    
-    struct psf_tag *tags;
 };
 
 typedef struct {
@@ -312,7 +346,8 @@ int psf1_load(void * context, const uint8_t * exe, size_t exe_size,
 
 static int EMU_CALL virtual_readfile(void *context, const char *path, int offset, char *buffer, int length)
 {
-    return psf2fs_virtual_readfile(context, path, offset, buffer, length);
+    const Fooyin::XSFInput::psf2_vfs * vfs = (const Fooyin::XSFInput::psf2_vfs *) context;
+    return vfs->read(path, offset, buffer, length);
 }
 
 struct sdsf_loader_state
@@ -400,19 +435,24 @@ static int psf_info_meta(void * context, const char * name, const char * value)
     {
         state->utf8 = true;
     }
-    else if ( *name != '_' )
-    {
-        if ( !strcasecmp( name, "game" ) ) name = "album";
-        else if ( !strcasecmp( name, "year" ) ) name = "date";
-        else if ( !strcasecmp( name, "tracknumber" ) ) name = "track";
-        else if ( !strcasecmp( name, "discnumber" ) ) name = "disc";
-
-        state->tags = add_tag( state->tags, name, value );
-    }
 
     return 0;
 }
 
+/* Name a tag is shown under, or NULL for tags which only control playback */
+static const char * psf_meta_name(const char * name)
+{
+    if ( *name == '_' || !strcasecmp( name, "length" ) || !strcasecmp( name, "fade" ) || !strcasecmp( name, "utf8" ) )
+        return NULL;
+
+    if ( !strcasecmp( name, "game" ) ) return "album";
+    if ( !strcasecmp( name, "year" ) ) return "date";
+    if ( !strcasecmp( name, "tracknumber" ) ) return "track";
+    if ( !strcasecmp( name, "discnumber" ) ) return "disc";
+
+    return name;
+}
+
 static int qsf_upload_section( struct qsf_loader_state * state, const char * section, uint32_t start,
                            const uint8_t * data, uint32_t size )
 {
@@ -500,6 +540,9 @@ static int gsf_loader(void * context, const uint8_t * exe, size_t exe_size,
         state->data = 0;
         state->data_size = 0;
     }
+    /* The map keeps its power of two size, which the cores mask ROM
+     * addresses with, but lives in sparse memory: only pages covered by
+     * a section are committed, and the rest reads as zero. */
     if (!iptr)
     {
         size_t rsize = xofs + xsize;
@@ -512,10 +555,9 @@ static int gsf_loader(void * context, const uint8_t * exe, size_t exe_size,
             rsize |= rsize >> 16;
             rsize += 1;
         }
-        iptr = (unsigned char *) malloc(rsize + 10);
+        iptr = psf_sparse_alloc(rsize + 10);
         if (!iptr)
             return -1;
-        memset(iptr, 0, rsize + 10);
         isize = rsize;
     }
     else if (isize < xofs + xsize)
@@ -530,12 +572,9 @@ static int gsf_loader(void * context, const uint8_t * exe, size_t exe_size,
             rsize |= rsize >> 16;
             rsize += 1;
         }
-        xptr = (unsigned char *) realloc(iptr, xofs + rsize + 10);
+        xptr = psf_sparse_grow(iptr, isize + 10, rsize + 10);
         if (!xptr)
-        {
-            free(iptr);
             return -1;
-        }
         iptr = xptr;
         isize = rsize;
     }
@@ -547,22 +586,65 @@ static int gsf_loader(void * context, const uint8_t * exe, size_t exe_size,
     return 0;
 }
 
+/* Frames of GSF output parked between calls, a power of two */
+constexpr unsigned long GsfRingLen = BufferLen * 4;
+
+/* Blocks posted by the core are read out of the blips straight into the
+ * caller's buffer while it has room; only the rest of the last block is
+ * parked in the ring, and handed out from there by the next call. */
 struct gsf_running_state
 {
     struct mAVStream stream;
-    void * rom;
-    int16_t samples[BufferLen * 2];
-    int buffered;
+    int16_t * out;
+    unsigned long wanted;
+    /* Free running frame counts; positions are taken modulo GsfRingLen */
+    unsigned long read_pos;
+    unsigned long write_pos;
+    int16_t samples[GsfRingLen * 2];
 };
 
+/* Moves frames out of the blips into the ring, or drops them */
+static void _gsf_ring_fill(struct gsf_running_state * state, blip_t * left, blip_t * right, unsigned long frames, bool keep)
+{
+    if ( keep && state->write_pos - state->read_pos + frames > GsfRingLen )
+        state->read_pos = state->write_pos + frames - GsfRingLen;
+
+    while ( frames ) {
+        unsigned long pos = state->write_pos % GsfRingLen;
+        unsigned long run = std::min( frames, GsfRingLen - pos );
+        blip_read_samples(left, state->samples + pos * 2, (int) run, true);
+        blip_read_samples(right, state->samples + pos * 2 + 1, (int) run, true);
+        if ( keep )
+            state->write_pos += run;
+        frames -= run;
+    }
+}
+
 static void _gsf_postAudioBuffer(struct mAVStream * stream, blip_t * left, blip_t * right)
 {
     struct gsf_running_state * state = ( struct gsf_running_state * ) stream;
-    blip_read_samples(left, state->samples, BufferLen, true);
-    blip_read_samples(right, state->samples + 1, BufferLen, true);
-    state->buffered = BufferLen;
+    unsigned long frames = BufferLen;
+    unsigned long direct = std::min( frames, state->wanted );
+
+    if ( direct ) {
+        if ( state->out ) {
+            blip_read_samples(left, state->out, (int) direct, true);
+            blip_read_samples(right, state->out + 1, (int) direct, true);
+            state->out += direct * 2;
+        } else {
+            _gsf_ring_fill( state, left, right, direct, false );
+        }
+        state->wanted -= direct;
+        frames -= direct;
+    }
+
+    if ( frames )
+        _gsf_ring_fill( state, left, right, frames, true );
 }
 
+/* The ring and its positions, which are laid out last, in one block */
+constexpr size_t gsf_ring_state_size = sizeof(gsf_running_state) - offsetof(gsf_running_state, read_pos);
+
 struct usf_loader_state
 {
     uint32_t enablecompare;
@@ -614,20 +696,19 @@ struct twosf_loader_state
 
     ~twosf_loader_state()
     {
-        if (rom) free(rom);
+        if (rom) psf_sparse_free(rom, rom_size + 10);
         if (state) free(state);
     }
 };
 
-static int load_twosf_map(struct twosf_loader_state *state, int issave, const unsigned char *udata, unsigned usize)
+/* Makes sure the ROM or save state map covers xofs + xsize bytes, and
+ * returns where that range starts in it. On failure the map is freed.
+ */
+static unsigned char * twosf_map_reserve(struct twosf_loader_state *state, int issave, unsigned xofs, unsigned xsize)
 {
-    if (usize < 8) return -1;
-
     unsigned char *iptr;
     size_t isize;
     unsigned char *xptr;
-    unsigned xsize = get_le32(udata + 4);
-    unsigned xofs = get_le32(udata + 0);
     if (issave)
     {
         iptr = state->state;
@@ -644,7 +725,7 @@ static int load_twosf_map(struct twosf_loader_state *state, int issave, const un
     }
     if (!iptr)
     {
-        size_t rsize = xofs + xsize;
+        size_t rsize = (size_t)xofs + xsize;
         if (!issave)
         {
             rsize -= 1;
@@ -655,15 +736,22 @@ static int load_twosf_map(struct twosf_loader_state *state, int issave, const un
             rsize |= rsize >> 16;
             rsize += 1;
         }
-        iptr = (unsigned char *) malloc(rsize + 10);
+        /* ROM maps are sparse, like the GSF one; save states are dense */
+        if (!issave)
+            iptr = psf_sparse_alloc(rsize + 10);
+        else
+        {
+            iptr = (unsigned char *) malloc(rsize + 10);
+            if (iptr)
+                memset(iptr, 0, rsize + 10);
+        }
         if (!iptr)
-            return -1;
-        memset(iptr, 0, rsize + 10);
+            return 0;
         isize = rsize;
     }
-    else if (isize < xofs + xsize)
+    else if (isize < (size_t)xofs + xsize)
     {
-        size_t rsize = xofs + xsize;
+        size_t rsize = (size_t)xofs + xsize;
         if (!issave)
         {
             rsize -= 1;
@@ -674,16 +762,26 @@ static int load_twosf_map(struct twosf_loader_state *state, int issave, const un
             rsize |= rsize >> 16;
             rsize += 1;
         }
-        xptr = (unsigned char *) realloc(iptr, xofs + rsize + 10);
-        if (!xptr)
+        if (!issave)
         {
-            free(iptr);
-            return -1;
+            xptr = psf_sparse_grow(iptr, isize + 10, rsize + 10);
+            if (!xptr)
+                return 0;
+        }
+        else
+        {
+            xptr = (unsigned char *) realloc(iptr, rsize + 10);
+            if (!xptr)
+            {
+                free(iptr);
+                return 0;
+            }
+            /* Inflated chunks land here directly, so gaps must read as zero */
+            memset(xptr + isize + 10, 0, rsize - isize);
         }
         iptr = xptr;
         isize = rsize;
     }
-    memcpy(iptr + xofs, udata + 8, xsize);
     if (issave)
     {
         state->state = iptr;
@@ -694,71 +792,46 @@ static int load_twosf_map(struct twosf_loader_state *state, int issave, const un
         state->rom = iptr;
         state->rom_size = isize;
     }
+    return iptr + xofs;
+}
+
+static int load_twosf_map(struct twosf_loader_state *state, int issave, const unsigned char *udata, unsigned usize)
+{
+    if (usize < 8) return -1;
+
+    unsigned xsize = get_le32(udata + 4);
+    unsigned xofs = get_le32(udata + 0);
+    if (xsize > usize - 8) return -1;
+
+    unsigned char *dest = twosf_map_reserve(state, issave, xofs, xsize);
+    if (!dest)
+        return -1;
+    memcpy(dest, udata + 8, xsize);
     return 0;
 }
 
+/* SAVE chunks are inflated straight into the state map: first the 8 byte
+ * offset and size header, then the data itself, in a single pass over the
+ * compressed stream. The chunk CRC has never been checked.
+ */
 static int load_twosf_mapz(struct twosf_loader_state *state, int issave, const unsigned char *zdata, unsigned zsize, unsigned zcrc)
 {
-    int ret;
-    int zerr;
-    uLongf usize = 8;
-    uLongf rsize = usize;
-    unsigned char *udata;
-    unsigned char *rdata;
+    (void)zcrc;
+
+    psf_inflate_stream stream(zdata, zsize);
 
-    udata = (unsigned char *) malloc(usize);
-    if (!udata)
+    unsigned char header[8];
+    if (!stream.read(header, sizeof(header)))
         return -1;
 
-    while (Z_OK != (zerr = uncompress(udata, &usize, zdata, zsize)))
-    {
-        if (Z_MEM_ERROR != zerr && Z_BUF_ERROR != zerr)
-        {
-            free(udata);
-            return -1;
-        }
-        if (usize >= 8)
-        {
-            usize = get_le32(udata + 4) + 8;
-            if (usize < rsize)
-            {
-                rsize += rsize;
-                usize = rsize;
-            }
-            else
-                rsize = usize;
-        }
-        else
-        {
-            rsize += rsize;
-            usize = rsize;
-        }
-        rdata = (unsigned char *) realloc(udata, usize);
-        if (!rdata)
-        {
-            free(udata);
-            return -1;
-        }
-        udata = rdata;
-    }
+    unsigned xsize = get_le32(header + 4);
+    unsigned xofs = get_le32(header + 0);
 
-    rdata = (unsigned char *) realloc(udata, usize);
-    if (!rdata)
-    {
-        free(udata);
+    unsigned char *dest = twosf_map_reserve(state, issave, xofs, xsize);
+    if (!dest || !stream.read(dest, xsize))
         return -1;
-    }
 
-    if (0)
-    {
-        uLong ccrc = crc32(crc32(0L, Z_NULL, 0), rdata, (uInt) usize);
-        if (ccrc != zcrc)
-            return -1;
-    }
-
-    ret = load_twosf_map(state, issave, rdata, (unsigned) usize);
-    free(rdata);
-    return ret;
+    return 0;
 }
 
 static int twosf_loader(void * context, const uint8_t * exe, size_t exe_size,
@@ -865,35 +938,29 @@ struct s9x_loaderwork {
     s9x_loaderwork() : first(false) { }
 };
 
+/* The APU keeps its mixed output until it is read, so frames are read
+ * straight into the caller's buffer, as many as it has room for; the rest
+ * stay with the APU for the next call. */
 class s9x_BUFFER {
 public:
     struct S9xState st;
+    /* Only written to when frames are skipped rather than returned */
     std::vector<uint8_t> buf;
-    unsigned fil, cur, len;
-    s9x_BUFFER() : buf(), fil(0), cur(0), len(0) { }
+    s9x_BUFFER() : buf() { }
     bool Init() {
-        if (!this->buf.empty())
-            this->buf.clear();
-        this->len = 2 * 2 * 48000 / 5;
-        this->buf.resize(len, 0);
-        this->fil = this->cur = 0;
+        this->buf.assign(BufferLen * 4, 0);
         return true;
     }
     void Fill() {
         S9xSyncSound(&st);
         S9xMainLoop(&st);
-        this->Mix();
     }
-    void Mix() {
-        unsigned bytes = (S9xGetSampleCount(&st) << 1) & ~3;
-        unsigned bleft = (this->len - this->fil) & ~3;
-        if (!bytes)
-            return;
-        if (bytes > bleft)
-            bytes = bleft;
-        std::fill_n(&this->buf[this->fil], bytes, 0);
-        S9xMixSamples(&st, &this->buf[this->fil], bytes >> 1);
-        this->fil += bytes;
+    unsigned Available() {
+        return (unsigned) S9xGetSampleCount(&st) >> 1;
+    }
+    void Mix(uint8_t *out, unsigned frames) {
+        std::fill_n(out, frames * 4, 0);
+        S9xMixSamples(&st, out, frames * 2);
     }
 };
 
@@ -953,44 +1020,6 @@ static int MapSNSF(void *context, const uint8_t *exe, size_t exe_size,
     return 0;
 }
 
-static void * psf_file_fopen( void *context, const char * uri )
-{
-    (void)context;
-    return fopen( uri, "rb" );
-}
-
-static size_t psf_file_fread( void * buffer, size_t size, size_t count, void * handle )
-{
-    return fread( buffer, size, count, (FILE *) handle );
-}
-
-static int psf_file_fseek( void * handle, int64_t offset, int whence )
-{
-    return fseek( (FILE *) handle, offset, whence );
-}
-
-static int psf_file_fclose( void * handle )
-{
-    fclose( (FILE *) handle );
-    return 0;
-}
-
-static long psf_file_ftell( void * handle )
-{
-    return ftell( (FILE *) handle );
-}
-
-const psf_file_callbacks psf_file_system =
-{
-    "\\/|:",
-    NULL,
-    psf_file_fopen,
-    psf_file_fread,
-    psf_file_fseek,
-    psf_file_fclose,
-    psf_file_ftell
-};
-
 int
 get_srate(int version)
 {
@@ -1012,6 +1041,25 @@ get_srate(int version)
     return -1;
 }
 
+static const char *
+get_format_name(int version)
+{
+    switch (version)
+    {
+        case 1: return "PSF";
+        case 2: return "PSF2";
+        case 0x11: return "SSF";
+        case 0x12: return "DSF";
+        case 0x21: return "USF";
+        case 0x22: return "GSF";
+        case 0x23: return "SNSF";
+        case 0x24: return "2SF";
+        case 0x25: return "NCSF";
+        case 0x41: return "QSF";
+    }
+    return "xSF";
+}
+
 static void
 psf_error_log(void * unused, const char * message) {
     fprintf(stderr, "%s", message);
@@ -1027,14 +1075,149 @@ QStringList fileExtensions()
 } // namespace
 
 namespace Fooyin::XSFInput {
+/* Final program image of a track, as assembled by the format loader. Kept
+ * by the decoder after the first emu_init, so re-initializing for a
+ * backward seek only has to copy it back into a freshly reset core.
+ *
+ * Images are immutable once built and shared between every decoder
+ * playing the same chain, so cores which keep a pointer to their ROM
+ * (GSF, 2SF, NCSF, QSF, and the PSF2 filesystem) read it from here
+ * instead of a private copy.
+ */
+struct xsf_image
+{
+    /* PSF2 filesystem and refresh rate */
+    psf2_vfs vfs;
+    int refresh;
+
+    /* SSF/DSF program, load address first */
+    std::vector<uint8_t> program;
+
+    /* GSF and 2SF ROM, taken over from the loader's sparse map. It carries
+     * the loaders' 10 bytes of slack past rom_size.
+     */
+    uint8_t * rom_map;
+    size_t rom_size;
+
+    /* SNSF ROM and SRAM, 2SF save state */
+    std::vector<uint8_t> rom;
+    std::vector<uint8_t> sram;
+    std::vector<uint8_t> state;
+
+    /* 2SF tags */
+    int initial_frames;
+    int sync_type;
+    int arm7_clockdown_level;
+    int arm9_clockdown_level;
+
+    /* NCSF */
+    uint32_t sseq;
+    std::vector<uint8_t> sdat;
+
+    /* QSF */
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> z80_rom;
+    std::vector<uint8_t> sample_rom;
+
+    xsf_image()
+    : refresh(0), rom_map(NULL), rom_size(0), initial_frames(-1), sync_type(0), arm7_clockdown_level(0), arm9_clockdown_level(0), sseq(0)
+    {
+    }
+
+    ~xsf_image()
+    {
+        psf_sparse_free(rom_map, rom_size + 10);
+    }
+
+    xsf_image(const xsf_image &) = delete;
+    xsf_image & operator=(const xsf_image &) = delete;
+};
+
+/* Process-wide registry of live images, keyed by version and chain. It
+ * holds no references itself; an image goes away with its last decoder.
+ */
+class xsf_image_store
+{
+public:
+    std::shared_ptr<const xsf_image> find(const std::string & key)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_images.find(key);
+        if (it == m_images.end())
+            return {};
+        return it->second.lock();
+    }
+
+    std::shared_ptr<const xsf_image> insert(const std::string & key, std::shared_ptr<const xsf_image> image)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        for (auto it = m_images.begin(); it != m_images.end();) {
+            if (it->second.expired())
+                it = m_images.erase(it);
+            else
+                ++it;
+        }
+
+        auto & entry = m_images[key];
+        if (auto existing = entry.lock())
+            return existing;
+        entry = image;
+        return image;
+    }
+
+private:
+    std::mutex m_lock;
+    std::unordered_map<std::string, std::weak_ptr<const xsf_image>> m_images;
+};
+
+static xsf_image_store & image_store()
+{
+    static xsf_image_store store;
+    return store;
+}
+
 XSFDecoder::XSFDecoder()
 {
     m_format.setSampleFormat(Fooyin::SampleFormat::S16);
     m_format.setChannelCount(2);
+    m_version = 0;
     m_emulator = NULL;
     m_emulatorExtra = NULL;
     framesRead = -1;
     m_isDecoding = false;
+    m_aheadLength = 0;
+    m_aheadFrames = 0;
+    m_aheadStop = false;
+    m_aheadEnded = false;
+    m_silenceStop = 0;
+    m_silenceEnd = -1;
+    m_silenceApplied = false;
+    totalFrames = 0;
+    m_aheadTotal = 0;
+    m_seekCacheLimit = 0;
+    m_seekStateSize = 0;
+    m_fastSeek = false;
+    m_twosfFrames = 0;
+    m_twosfInitFrames = 0;
+    m_twosfCancel = false;
+    m_dspMode = DspInterpreter;
+    m_dspCheckFrames = 0;
+    m_dspCheckMismatches = 0;
+    m_dspCheckMaxError = 0;
+    m_usfCore = UsfInterpreter;
+    m_usfFrames = 0;
+    m_usfRenderTime = 0;
+    m_quality = QualityBalanced;
+    m_renderFrames = 0;
+    m_renderTime = 0;
+    sampleRate = 0;
+    m_outputRate = 0;
+}
+
+XSFDecoder::~XSFDecoder()
+{
+    emu_cleanup();
 }
 
 QStringList XSFDecoder::extensions() const
@@ -1057,18 +1240,108 @@ Fooyin::Track XSFDecoder::changedTrack() const
     return m_changedTrack;
 }
 
+static void twosf_destroy(NDS_state * nds_state)
+{
+    if (nds_state) {
+        state_deinit(nds_state);
+        free(nds_state);
+    }
+}
+
+/* A 2SF core as the image sets it up, run for frames more. Only reads the
+ * shared image, so spare cores can be built on another thread; setting
+ * cancel makes such a build give up and return NULL.
+ */
+static NDS_state * twosf_create(const xsf_image & image, int interpolation, unsigned long frames,
+                                const std::atomic<bool> * cancel = NULL)
+{
+    NDS_state * nds_state = (NDS_state *) calloc(1, sizeof(*nds_state));
+    if (!nds_state) {
+        return NULL;
+    }
+
+    if (state_init(nds_state)) {
+        twosf_destroy(nds_state);
+        return NULL;
+    }
+
+    nds_state->dwInterpolation = interpolation;
+    nds_state->dwChannelMute = 0;
+
+    nds_state->initial_frames = image.initial_frames;
+    nds_state->sync_type = image.sync_type;
+    nds_state->arm7_clockdown_level = image.arm7_clockdown_level;
+    nds_state->arm9_clockdown_level = image.arm9_clockdown_level;
+
+    /* The cartridge is read-only to the emulated NDS */
+    if (image.rom_map)
+        state_setrom(nds_state, image.rom_map, (u32)image.rom_size, 0);
+
+    state_loadstate(nds_state, image.state.empty() ? NULL : image.state.data(), (u32)image.state.size());
+
+    int16_t temp[2048];
+    while (frames) {
+        if (cancel && *cancel) {
+            twosf_destroy(nds_state);
+            return NULL;
+        }
+        unsigned framesThisRun = (unsigned) std::min<unsigned long>(frames, 1024);
+        state_render( nds_state, temp, framesThisRun );
+        frames -= framesThisRun;
+    }
+
+    return nds_state;
+}
+
 void XSFDecoder::emu_cleanup()
 {
-    if (m_version == 0x02) {
+    stop_render_ahead();
+
+    save_seek_cache();
+
+    /* States are only ever restored into the core they were taken from */
+    m_snapshots.clear();
+    m_initState.clear();
+    drop_twosf_spare();
+
+    if (m_renderFrames && m_renderTime && sampleRate > 0) {
+        const double seconds = (double)m_renderFrames / sampleRate;
+        const double elapsed = (double)m_renderTime / 1e9;
+        qCDebug(XSF_INPUT) << get_format_name(m_version) << "at" << QualitySettings[m_quality].name << "quality rendered"
+                           << seconds << "s in" << elapsed * 1000 << "ms," << seconds / elapsed << "x realtime";
+        /* Shown next to the profile in the settings dialog */
+        if (seconds >= RenderSpeedSeconds) {
+            const QString key = QString::fromLatin1(RenderSpeed) + u"/"_s + QString::number(m_quality);
+            m_settings.setValue(key + u"/Format"_s, QString::fromLatin1(get_format_name(m_version)));
+            m_settings.setValue(key + u"/Speed"_s, seconds / elapsed);
+        }
+    }
+    m_renderFrames = 0;
+    m_renderTime = 0;
+
+    if (m_version == 0x21) {
+        if (m_usfFrames && m_usfRenderTime && sampleRate > 0) {
+            static const char * const cores[] = {"interpreter", "cached interpreter", "recompiler"};
+            const double seconds = (double)m_usfFrames / sampleRate;
+            const double elapsed = (double)m_usfRenderTime / 1e9;
+            qCDebug(XSF_INPUT) << "USF" << cores[m_usfCore] << "rendered" << seconds << "s in" << elapsed * 1000 << "ms,"
+                               << seconds / elapsed << "x realtime";
+        }
+        m_usfFrames = 0;
+        m_usfRenderTime = 0;
         if(m_emulator) {
+            usf_shutdown(m_emulator);
             free(m_emulator);
         }
-        if(m_emulatorExtra) {
-            psf2fs_delete(m_emulatorExtra);
+    } else if (m_version == 0x11 || m_version == 0x12) {
+        if (m_dspCheckFrames) {
+            qCInfo(XSF_INPUT) << "DSP dynarec checked over" << m_dspCheckFrames << "frames:" << m_dspCheckMismatches
+                              << "samples differ, largest difference" << m_dspCheckMaxError;
+            m_dspCheckFrames = 0;
         }
-    } else if (m_version == 0x21) {
+        m_dspCheckState.clear();
+        m_dspCheckBuffer.clear();
         if(m_emulator) {
-            usf_shutdown(m_emulator);
             free(m_emulator);
         }
     } else if (m_version == 0x22) {
@@ -1079,9 +1352,7 @@ void XSFDecoder::emu_cleanup()
         }
         if (m_emulatorExtra)
         {
-            struct gsf_running_state * rstate = ( struct gsf_running_state * ) m_emulatorExtra;
-            free( rstate->rom );
-            free( rstate );
+            free( m_emulatorExtra );
         }
     } else if (m_version == 0x23) {
         if(m_emulator) {
@@ -1093,14 +1364,7 @@ void XSFDecoder::emu_cleanup()
             delete buffer;
         }
     } else if (m_version == 0x24) {
-        if(m_emulator) {
-            NDS_state * state = (NDS_state *) m_emulator;
-            state_deinit(state);
-            free(state);
-        }
-        if(m_emulatorExtra) {
-            free(m_emulatorExtra);
-        }
+        twosf_destroy((NDS_state *) m_emulator);
     } else if (m_version == 0x25) {
         {
             if(m_emulator) {
@@ -1112,17 +1376,6 @@ void XSFDecoder::emu_cleanup()
     		    delete state;
             }
         }
-    } else if(m_version == 0x41) {
-        if(m_emulator) {
-            free(m_emulator);
-        }
-        if(m_emulatorExtra) {
-            struct qsf_loader_state * state = (struct qsf_loader_state *) m_emulatorExtra;
-            free(state->key);
-            free(state->z80_rom);
-            free(state->sample_rom);
-            free(state);
-        }
     } else {
         if(m_emulator) {
             free(m_emulator);
@@ -1132,54 +1385,221 @@ void XSFDecoder::emu_cleanup()
     m_emulatorExtra = NULL;
 }
 
-int XSFDecoder::emu_init() {
-    silenceSeconds = 5;
-
-    usfRemoveSilence = false;
+int XSFDecoder::emu_load()
+{
+    if (m_image)
+        return 0;
 
-    if (m_version == 1 || m_version == 2)
+    switch (m_version)
     {
-        m_emulator = malloc(psx_get_state_size(m_version));
+        case 0x02: case 0x11: case 0x12: case 0x22: case 0x23: case 0x24: case 0x25: case 0x41:
+            break;
 
-        if (!m_emulator) {
-            return -1;
-        }
+        default:
+            /* PSF and USF loaders upload straight into the core state */
+            return 0;
+    }
 
-        psx_clear_state(m_emulator, m_version);
+    /* PSF2 and 2SF tags come from the whole chain, so collect them while
+     * resolving it
+     */
+    struct twosf_loader_state twosf_state;
+    memset(&twosf_state, 0, sizeof(twosf_state));
 
-        if (m_version == 1) {
-            psf1_load_state state;
+    psf1_load_state psf2_state;
+    psf2_state.refresh = 0;
 
-            state.emu = m_emulator;
-            state.first = true;
-            state.refresh = 0;
+    psf_info_callback info = 0;
+    void * info_context = 0;
+    if (m_version == 0x02) {
+        info = psf1_info;
+        info_context = &psf2_state;
+    } else if (m_version == 0x24) {
+        info = twosf_info;
+        info_context = &twosf_state;
+    }
+
+    std::vector<psf_section_ref> sections;
+    if (psf_load_sections(m_path.toUtf8().constData(), m_version, sections, info, info_context, 1, psf_error_log, 0) <= 0)
+        return -1;
+
+    std::string key = std::to_string(m_version);
+    for (const auto & section : sections) {
+        key += '\n';
+        key += section->key;
+    }
+
+    m_image = image_store().find(key);
+    if (m_image)
+        return 0;
+
+    auto image = std::make_shared<xsf_image>();
 
-            if (psf_load(m_path.toUtf8().constData(), &psf_file_system, 1, psf1_load, &state, psf1_info, &state, 1, psf_error_log, 0) <= 0) {
+    if (m_version == 0x02)
+    {
+        for (const auto & section : sections) {
+            if (!image->vfs.add(section)) {
+                psf_error_log(0, "Invalid format\n");
                 return -1;
             }
+        }
 
-            if (state.refresh)
-                psx_set_refresh(m_emulator, state.refresh);
+        image->refresh = psf2_state.refresh;
+    }
+    else if (m_version == 0x11 || m_version == 0x12)
+    {
+        struct sdsf_loader_state state;
+        memset(&state, 0, sizeof(state));
+
+        if (psf_feed_sections(sections, sdsf_loader, &state, psf_error_log, 0) < 0 || !state.data) {
+            free(state.data);
+            return -1;
         }
-        else if (m_version == 2)
-        {
-            m_emulatorExtra = psf2fs_create();
-            if (!m_emulatorExtra) {
-                return -1;
-            }
 
+        image->program.assign(state.data, state.data + state.data_size);
+        free(state.data);
+    }
+    else if (m_version == 0x22)
+    {
+        struct gsf_loader_state state;
+        memset(&state, 0, sizeof(state));
+
+        if (psf_feed_sections(sections, gsf_loader, &state, psf_error_log, 0) < 0) {
+            psf_sparse_free(state.data, state.data_size + 10);
+            return -1;
+        }
+
+        if (!state.data || state.data_size > UINT_MAX) {
+            psf_sparse_free(state.data, state.data_size + 10);
+            return -1;
+        }
+
+        image->rom_map = state.data;
+        image->rom_size = state.data_size;
+    }
+    else if (m_version == 0x23)
+    {
+        s9x_loaderwork loaderwork;
+
+        if(psf_feed_sections(sections, MapSNSF, &loaderwork, psf_error_log, 0) < 0)
+            return -1;
+
+        if(loaderwork.rom.empty())
+            return -1;
+
+        image->rom = std::move(loaderwork.rom);
+        image->sram = std::move(loaderwork.sram);
+    }
+    else if (m_version == 0x24)
+    {
+        struct twosf_loader_state & state = twosf_state;
+
+        if (psf_feed_sections(sections, twosf_loader, &state, psf_error_log, 0) < 0) {
+            return -1;
+        }
+
+        if (!state.arm7_clockdown_level)
+            state.arm7_clockdown_level = state.clockdown;
+        if (!state.arm9_clockdown_level)
+            state.arm9_clockdown_level = state.clockdown;
+
+        if (state.rom) {
+            image->rom_map = state.rom;
+            image->rom_size = state.rom_size;
+            state.rom = 0;
+        }
+        if (state.state)
+            image->state.assign(state.state, state.state + state.state_size);
+
+        image->initial_frames = state.initial_frames;
+        image->sync_type = state.sync_type;
+        image->arm7_clockdown_level = state.arm7_clockdown_level;
+        image->arm9_clockdown_level = state.arm9_clockdown_level;
+    }
+    else if (m_version == 0x25)
+    {
+        struct ncsf_loader_state state;
+
+        if(psf_feed_sections(sections, ncsf_loader, &state, psf_error_log, 0) < 0) {
+            return -1;
+        }
+
+        image->sseq = state.sseq;
+        image->sdat = std::move(state.sdatData);
+    }
+    else if (m_version == 0x41)
+    {
+        struct qsf_loader_state state;
+        memset(&state, 0, sizeof(state));
+
+        int err = psf_feed_sections(sections, qsf_load, &state, psf_error_log, 0);
+        if (err == 0) {
+            image->key.assign(state.key, state.key + state.key_size);
+            image->z80_rom.assign(state.z80_rom, state.z80_rom + state.z80_size);
+            image->sample_rom.assign(state.sample_rom, state.sample_rom + state.sample_size);
+        }
+
+        free(state.key);
+        free(state.z80_rom);
+        free(state.sample_rom);
+
+        if (err < 0)
+            return -1;
+    }
+
+    m_image = image_store().insert(key, std::move(image));
+
+    return 0;
+}
+
+int XSFDecoder::emu_init() {
+    if (emu_load() < 0) {
+        return -1;
+    }
+
+    switch (m_version)
+    {
+        case 1: case 2: psx_core_init(); break;
+        case 0x11: case 0x12: sega_core_init(); break;
+        case 0x22: gsf_core_init(); break;
+        case 0x41: qsound_core_init(); break;
+    }
+
+    silenceSeconds = 5;
+
+    usfRemoveSilence = false;
+
+    if (m_version == 1 || m_version == 2)
+    {
+        m_emulator = malloc(psx_get_state_size(m_version));
+
+        if (!m_emulator) {
+            return -1;
+        }
+
+        psx_clear_state(m_emulator, m_version);
+
+        if (m_version == 1) {
             psf1_load_state state;
 
+            state.emu = m_emulator;
+            state.first = true;
             state.refresh = 0;
 
-            if (psf_load(m_path.toUtf8().constData(), &psf_file_system, 2, psf2fs_load_callback, m_emulatorExtra, psf1_info, &state, 1, psf_error_log, 0) <= 0) {
+            if (psf_load_cached(m_path.toUtf8().constData(), 1, psf1_load, &state, psf1_info, &state, 1, psf_error_log, 0) <= 0) {
                 return -1;
             }
 
             if (state.refresh)
                 psx_set_refresh(m_emulator, state.refresh);
+        }
+        else if (m_version == 2)
+        {
+            if (m_image->refresh)
+                psx_set_refresh(m_emulator, m_image->refresh);
 
-            psx_set_readfile(m_emulator, virtual_readfile, m_emulatorExtra);
+            /* IOP file reads are served from the shared image */
+            psx_set_readfile(m_emulator, virtual_readfile, (void *) &m_image->vfs);
         }
 
         silenceSeconds = 30;
@@ -1189,17 +1609,9 @@ int XSFDecoder::emu_init() {
     }
     else if (m_version == 0x11 || m_version == 0x12)
     {
-        struct sdsf_loader_state state;
-        memset(&state, 0, sizeof(state));
-
-        if (psf_load(m_path.toUtf8().constData(), &psf_file_system, m_version, sdsf_loader, &state, 0, 0, 0, psf_error_log, 0) <= 0) {
-            return -1;
-        }
-
         m_emulator = malloc(sega_get_state_size(m_version - 0x10));
 
         if (!m_emulator) {
-            free(state.data);
             return -1;
         }
 
@@ -1208,16 +1620,18 @@ int XSFDecoder::emu_init() {
         sega_enable_dry(m_emulator, 1);
         sega_enable_dsp(m_emulator, 1);
 
-        sega_enable_dsp_dynarec(m_emulator, 0);
+        sega_enable_dsp_dynarec(m_emulator, m_dspMode != DspInterpreter);
+        m_dspCheckFrames = 0;
+        m_dspCheckMismatches = 0;
+        m_dspCheckMaxError = 0;
 
-        uint32_t start = get_le32(state.data);
-        size_t length = state.data_size;
+        const std::vector<uint8_t> & program = m_image->program;
+        uint32_t start = get_le32(program.data());
+        size_t length = program.size();
         const size_t max_length = (m_version == 0x12) ? 0x800000 : 0x80000;
         if ((start + (length - 4)) > max_length)
             length = max_length - start + 4;
-        sega_upload_program(m_emulator, state.data, (uint32_t)length);
-
-        free(state.data);
+        sega_upload_program(m_emulator, (void *) program.data(), (uint32_t)length);
     }
     else if (m_version == 0x21)
     {
@@ -1232,10 +1646,13 @@ int XSFDecoder::emu_init() {
         usf_clear(state.emu_state);
 
         usf_set_hle_audio(state.emu_state, 1);
+#ifdef XSF_USF_CPU_CORE
+        usf_set_cpu_core(state.emu_state, m_usfCore);
+#endif
 
         m_emulator = (void *) state.emu_state;
 
-        if (psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x21, usf_loader, &state, usf_info, &state, 1, psf_error_log, 0) <= 0) {
+        if (psf_load_cached(m_path.toUtf8().constData(), 0x21, usf_loader, &state, usf_info, &state, 1, psf_error_log, 0) <= 0) {
             return -1;
         }
 
@@ -1247,53 +1664,41 @@ int XSFDecoder::emu_init() {
     }
     else if (m_version == 0x22)
     {
-        struct gsf_loader_state state;
-        memset(&state, 0, sizeof(state));
-
-        if (psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x22, gsf_loader, &state, 0, 0, 0, psf_error_log, 0) <= 0) {
-            return -1;
-        }
-
-        if (state.data_size > UINT_MAX) {
-            free(state.data);
-            return -1;
-        }
-
-        struct VFile * rom = VFileFromConstMemory(state.data, state.data_size);
+        struct VFile * rom = VFileFromConstMemory(m_image->rom_map, m_image->rom_size);
         if ( !rom ) {
-            free( state.data );
             return -1;
         }
 
         struct mCore * core = mCoreFindVF( rom );
         if ( !core ) {
-            free(state.data);
             return -1;
         }
 
         struct gsf_running_state * rstate = (struct gsf_running_state *) calloc(1, sizeof(struct gsf_running_state));
         if ( !rstate ) {
             core->deinit(core);
-            free(state.data);
             return -1;
         }
 
-        rstate->rom = state.data;
         rstate->stream.postAudioBuffer = _gsf_postAudioBuffer;
 
+        /* Audio only: no video buffer is ever given to the core, so mGBA
+         * keeps its dummy renderer and the PPU only advances its timing.
+         * Setting one would attach the software renderer and draw every
+         * scanline for nothing. */
         core->init(core);
         core->setAVStream(core, &rstate->stream);
         mCoreInitConfig(core, NULL);
 
         core->setAudioBufferSize(core, BufferLen);
 
-        blip_set_rates(core->getAudioChannel(core, 0), core->frequency(core), 44100);
-        blip_set_rates(core->getAudioChannel(core, 1), core->frequency(core), 44100);
+        blip_set_rates(core->getAudioChannel(core, 0), core->frequency(core), sampleRate);
+        blip_set_rates(core->getAudioChannel(core, 1), core->frequency(core), sampleRate);
 
         struct mCoreOptions opts = {
             .skipBios = true,
             .useBios = false,
-            .sampleRate = 44100,
+            .sampleRate = (unsigned) sampleRate,
             .volume = 0x100,
         };
 
@@ -1307,13 +1712,8 @@ int XSFDecoder::emu_init() {
     }
     else if (m_version == 0x23)
     {
-        s9x_loaderwork loaderwork;
-
-        if(psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x23, MapSNSF, &loaderwork, 0, 0, 0, psf_error_log, 0) <= 0)
-            return -1;
-
-        if(loaderwork.rom.empty())
-            return -1;
+        const std::vector<uint8_t> & rom = m_image->rom;
+        const std::vector<uint8_t> & sram = m_image->sram;
 
         s9x_BUFFER *buffer = new s9x_BUFFER;
 
@@ -1321,8 +1721,8 @@ int XSFDecoder::emu_init() {
 
         st->Settings.SoundSync = true;
         st->Settings.Mute = false;
-        st->Settings.SoundPlaybackRate = 32000;
-        st->Settings.InterpolationMethod = 2; // Gaussian
+        st->Settings.SoundPlaybackRate = sampleRate;
+        st->Settings.InterpolationMethod = QualitySettings[m_quality].snsfInterpolation;
 
         if(!st->Memory.Init(st))
             return -1;
@@ -1338,7 +1738,7 @@ int XSFDecoder::emu_init() {
             return -1;
         }
 
-        if (!st->Memory.LoadROMSNSF(&loaderwork.rom[0], (int32_t) loaderwork.rom.size(), !loaderwork.sram.empty() ? &loaderwork.sram[0] : nullptr, (int32_t) loaderwork.sram.size())) {
+        if (!st->Memory.LoadROMSNSF(&rom[0], (int32_t) rom.size(), !sram.empty() ? &sram[0] : nullptr, (int32_t) sram.size())) {
             S9xReset(st);
             st->Memory.Deinit();
             S9xDeinitAPU(st);
@@ -1352,66 +1752,31 @@ int XSFDecoder::emu_init() {
     }
     else if (m_version == 0x24)
     {
-        struct twosf_loader_state state;
-        memset(&state, 0, sizeof(state));
-
-        NDS_state * nds_state = (NDS_state *) calloc(1, sizeof(*nds_state));
-        if (!nds_state) {
-            return -1;
-        }
-
-        m_emulator = (void *) nds_state;
-
-        if (state_init(nds_state)) {
-            return -1;
-        }
-
-        if (psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x24, twosf_loader, &state, twosf_info, &state, 1, psf_error_log, 0) <= 0) {
+        m_emulator = (void *) twosf_create(*m_image, QualitySettings[m_quality].twosfInterpolation, 0);
+        if (!m_emulator) {
             return -1;
         }
-
-        if (!state.arm7_clockdown_level)
-            state.arm7_clockdown_level = state.clockdown;
-        if (!state.arm9_clockdown_level)
-            state.arm9_clockdown_level = state.clockdown;
-
-        nds_state->dwInterpolation = 1;
-        nds_state->dwChannelMute = 0;
-
-        nds_state->initial_frames = state.initial_frames;
-        nds_state->sync_type = state.sync_type;
-        nds_state->arm7_clockdown_level = state.arm7_clockdown_level;
-        nds_state->arm9_clockdown_level = state.arm9_clockdown_level;
-
-        if (state.rom)
-            state_setrom(nds_state, state.rom, (u32)state.rom_size, 0);
-
-        state_loadstate(nds_state, state.state, (u32)state.state_size);
-
-        m_emulatorExtra = state.rom;
-        state.rom = 0; // So twosf_loader_state doesn't free it when it goes out of scope
+        m_twosfFrames = 0;
     }
     else if (m_version == 0x25)
     {
         struct ncsf_loader_state *state = new struct ncsf_loader_state;
 
-        if(psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x25, ncsf_loader, state, 0, 0, 1, psf_error_log, 0) <= 0) {
-            delete state;
-            return -1;
-        }
+        state->sseq = m_image->sseq;
 
         Player *player = new Player;
 
-        player->interpolation = INTERPOLATION_SINC;
+        player->interpolation = QualitySettings[m_quality].ncsfInterpolation;
 
+        /* SDAT only reads from the shared image */
         PseudoFile file;
-        file.data = &state->sdatData;
+        file.data = const_cast<std::vector<uint8_t> *>(&m_image->sdat);
 
         state->sdat.reset(new SDAT(file, state->sseq));
 
         auto *sseqToPlay = state->sdat->sseq.get();
 
-        player->sampleRate = 44100;
+        player->sampleRate = sampleRate;
         player->Setup(sseqToPlay);
         player->Timer();
 
@@ -1422,18 +1787,6 @@ int XSFDecoder::emu_init() {
     }
     else if (m_version == 0x41)
     {
-        struct qsf_loader_state * state = (struct qsf_loader_state *) calloc(1, sizeof(*state));
-
-        if (!state) {
-            return -1;
-        }
-
-        m_emulatorExtra = (void *) state;
-
-        if ( psf_load(m_path.toUtf8().constData(), &psf_file_system, 0x41, qsf_load, state, 0, 0, 0, psf_error_log, 0) <= 0 ) {
-            return -1;
-        }
-
         m_emulator = malloc(qsound_get_state_size());
         if (!m_emulator) {
             return -1;
@@ -1441,8 +1794,8 @@ int XSFDecoder::emu_init() {
 
         qsound_clear_state(m_emulator);
 
-        if(state->key_size == 11) {
-            uint8_t * ptr = state->key;
+        if(m_image->key.size() == 11) {
+            const uint8_t * ptr = m_image->key.data();
             uint32_t swap_key1 = get_be32(ptr +  0);
             uint32_t swap_key2 = get_be32(ptr +  4);
             uint32_t addr_key  = get_be16(ptr +  8);
@@ -1451,31 +1804,140 @@ int XSFDecoder::emu_init() {
         } else {
             qsound_set_kabuki_key(m_emulator, 0, 0, 0, 0);
         }
-        qsound_set_z80_rom(m_emulator, state->z80_rom, state->z80_size);
-        qsound_set_sample_rom(m_emulator, state->sample_rom, state->sample_size);
+        /* Both ROMs stay owned by the shared image */
+        qsound_set_z80_rom(m_emulator, m_image->z80_rom.data(), (uint32_t)m_image->z80_rom.size());
+        qsound_set_sample_rom(m_emulator, m_image->sample_rom.data(), (uint32_t)m_image->sample_rom.size());
     } else {
         return -1;
     }
 
+    /* USF, GSF, SNSF and NCSF convert to any rate themselves; the others
+     * run at their own rate and go through the resampler */
+    switch (m_version)
+    {
+        case 0x21: case 0x22: case 0x23: case 0x25:
+            m_resampler.setup(sampleRate, sampleRate);
+            break;
+
+        default:
+            m_resampler.setup(get_srate(m_version), sampleRate, QualitySettings[m_quality].resamplerTaps);
+            m_resampleInput.resize(BufferLen * 2);
+            break;
+    }
+
     framesRead = 0;
 
-    silence_test_buffer.resize(sampleRate * silenceSeconds * 2);
+    silence_test_buffer.resize(SilenceBufferLen * 2);
 
-    if (!fill_buffer()) {
-        return -1;
+    /* Trim leading silence one buffer at a time, so the first audio is
+     * available as soon as it is rendered. fill_buffer fails once the run
+     * reaches silenceSeconds, which rejects tracks that never start. */
+    do {
+        if (!fill_buffer(framesRead, totalFrames)) {
+            return -1;
+        }
+        silence_test_buffer.remove_leading_silence();
+    } while (!silence_test_buffer.data_available());
+
+    if (m_version == 0x24) {
+        m_initBuffer = silence_test_buffer;
+        m_initResampler = m_resampler;
+        m_twosfInitFrames = m_twosfFrames;
+    } else if (emu_save(m_initState)) {
+        m_initBuffer = silence_test_buffer;
+        m_initResampler = m_resampler;
+    } else {
+        m_initState.clear();
     }
 
-    silence_test_buffer.remove_leading_silence();
-
     return 0;
 }
 
-bool XSFDecoder::fill_buffer()
+/* Rewinds to the start of the track by restoring the state captured at
+ * the end of emu_init, without reloading anything. 2SF swaps in its spare
+ * core instead. Without prepare, only a spare already started is used;
+ * with it, a missing spare is built here, and the next one is started in
+ * the background if the track loops.
+ */
+bool XSFDecoder::emu_restart(bool prepare)
+{
+    if (!m_emulator)
+        return false;
+
+    if (m_version == 0x24) {
+        if (!prepare && !m_twosfSpare.valid())
+            return false;
+
+        stop_render_ahead();
+
+        NDS_state * spare = m_twosfSpare.valid()
+            ? (NDS_state *) m_twosfSpare.get()
+            : twosf_create(*m_image, QualitySettings[m_quality].twosfInterpolation, m_twosfInitFrames);
+        if (!spare)
+            return false;
+        twosf_destroy((NDS_state *) m_emulator);
+        m_emulator = (void *) spare;
+        m_twosfFrames = m_twosfInitFrames;
+
+        /* Looping a track is certain to restart it again */
+        if (prepare && repeatOne)
+            start_twosf_spare();
+    } else {
+        if (m_initState.empty())
+            return false;
+
+        stop_render_ahead();
+
+        if (!emu_restore(m_initState))
+            return false;
+    }
+
+    m_resampler = m_initResampler;
+    silence_test_buffer = m_initBuffer;
+    framesRead = 0;
+    return true;
+}
+
+void XSFDecoder::start_twosf_spare()
 {
-    long _totalFrames = totalFrames;
+    if (m_twosfSpare.valid())
+        return;
+
+    std::shared_ptr<const xsf_image> image = m_image;
+    const int interpolation = QualitySettings[m_quality].twosfInterpolation;
+    const unsigned long frames = m_twosfInitFrames;
+    const std::atomic<bool> * cancel = &m_twosfCancel;
+    m_twosfCancel = false;
+    m_twosfSpare = std::async(std::launch::async, [image, interpolation, frames, cancel]() {
+        return (void *) twosf_create(*image, interpolation, frames, cancel);
+    });
+}
+
+/* A build still running is cancelled rather than waited out */
+void XSFDecoder::drop_twosf_spare()
+{
+    if (!m_twosfSpare.valid())
+        return;
+
+    m_twosfCancel = true;
+    twosf_destroy((NDS_state *) m_twosfSpare.get());
+}
+
+/* position is the frame the silence buffer's read side is at: framesRead
+ * normally, or the render-ahead thread's own position while it runs.
+ * total is the track length, 0 while it is not yet known.
+ * Returns false once nothing more can be buffered, or the audio has been
+ * silent for silenceSeconds.
+ */
+bool XSFDecoder::fill_buffer(long position, long total)
+{
+    long _totalFrames = total;
     if (!_totalFrames) // likely init stage
         _totalFrames = silenceSeconds * sampleRate;
-    long frames_left = _totalFrames - framesRead - silence_test_buffer.data_available() / 2;
+    const long silenceEnd = m_silenceEnd;
+    if (silenceEnd >= 0 && silenceEnd < _totalFrames)
+        _totalFrames = silenceEnd;
+    long frames_left = _totalFrames - position - silence_test_buffer.data_available() / 2;
     long free_space = silence_test_buffer.free_space() / 2;
     if (repeatOne)
         frames_left = free_space;
@@ -1490,10 +1952,147 @@ bool XSFDecoder::fill_buffer()
         silence_test_buffer.samples_written(frames * 2);
         free_space -= frames;
     }
-    return !silence_test_buffer.test_silence();
+    if (m_silenceStop && silenceEnd < 0) {
+        const long buffered = (long)silence_test_buffer.data_available() / 2;
+        const long silent = (long)silence_test_buffer.silent_tail() / 2;
+        /* A run that started before the first emitted frame is leading
+         * silence that emu_init is still trimming */
+        if (silent >= m_silenceStop && position + buffered - silent > 0)
+            m_silenceEnd = position + buffered - silent;
+    }
+    return silence_test_buffer.data_available() &&
+           silence_test_buffer.silent_tail() < (unsigned long)(silenceSeconds * sampleRate * 2);
+}
+
+void XSFDecoder::start_render_ahead()
+{
+    const size_t samples = (size_t)std::max(m_aheadLength, (long)BufferLen) * 2;
+    if (m_aheadRing.capacity() != samples)
+        m_aheadRing.resize(samples);
+    else
+        m_aheadRing.reset();
+
+    m_aheadFrames = framesRead;
+    m_aheadTotal = totalFrames;
+    m_aheadStop = false;
+    m_aheadEnded = false;
+    m_aheadThread = std::thread(&XSFDecoder::render_ahead, this);
 }
 
+/* Cancels the render-ahead thread. Audio still queued is dropped, and the
+ * emulator is left at the position the thread had rendered up to.
+ */
+void XSFDecoder::stop_render_ahead()
+{
+    if (!m_aheadThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_aheadLock);
+        m_aheadStop = true;
+    }
+    m_aheadWake.notify_all();
+    m_aheadThread.join();
+
+    framesRead = m_aheadFrames;
+    m_aheadRing.reset();
+}
+
+void XSFDecoder::render_ahead()
+{
+    int16_t chunk[BufferLen * 2];
+
+    while (!m_aheadStop) {
+        const size_t space = m_aheadRing.free_space() / 2;
+        if (space < (size_t)BufferLen) {
+            std::unique_lock<std::mutex> lock(m_aheadLock);
+            m_aheadWake.wait(lock, [this]() {
+                return m_aheadStop || m_aheadRing.free_space() / 2 >= (size_t)BufferLen;
+            });
+            continue;
+        }
+
+        take_snapshot(m_aheadFrames + (long)silence_test_buffer.data_available() / 2);
+        if (!fill_buffer(m_aheadFrames, m_aheadTotal))
+            break;
+
+        unsigned long frames = std::min(silence_test_buffer.data_available() / 2, (unsigned long)BufferLen);
+        silence_test_buffer.read(chunk, frames * 2);
+        m_aheadRing.write(chunk, frames * 2);
+        m_aheadFrames += frames;
+
+        {
+            std::lock_guard<std::mutex> lock(m_aheadLock);
+        }
+        m_aheadWake.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_aheadLock);
+        m_aheadEnded = true;
+    }
+    m_aheadWake.notify_all();
+}
+
+/* Blocks until the render-ahead thread has queued audio, or has ended.
+ * Returns the number of frames copied, 0 once the track has ended.
+ */
+size_t XSFDecoder::read_ahead(int16_t* out, size_t frames)
+{
+    for (;;) {
+        const size_t read = m_aheadRing.read(out, frames * 2) / 2;
+        if (read) {
+            {
+                std::lock_guard<std::mutex> lock(m_aheadLock);
+            }
+            m_aheadWake.notify_all();
+            return read;
+        }
+
+        std::unique_lock<std::mutex> lock(m_aheadLock);
+        m_aheadWake.wait(lock, [this]() { return m_aheadEnded || m_aheadRing.available(); });
+        if (!m_aheadRing.available())
+            return 0;
+    }
+}
+
+/* Renders count frames at the output rate, through the resampler when the
+ * core runs at a fixed rate of its own. Audible output is timed for the
+ * log; seeking is not.
+ */
 int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int err = 0;
+    if (!m_resampler.active()) {
+        err = emu_render_core(buf, count);
+    } else {
+        unsigned done = 0;
+        while (done < count) {
+            done += (unsigned) m_resampler.read(buf ? buf + done * 2 : NULL, count - done);
+            if (done >= count)
+                break;
+
+            unsigned frames = (unsigned) std::min(m_resampler.wanted(count - done), (size_t) BufferLen);
+            err = emu_render_core(m_resampleInput.data(), frames);
+            if (err < 0) {
+                count = done;
+                break;
+            }
+            m_resampler.write(m_resampleInput.data(), frames);
+        }
+    }
+
+    if (buf) {
+        m_renderTime += timer.nsecsElapsed();
+        m_renderFrames += count;
+    }
+    return err;
+}
+
+int XSFDecoder::emu_render_core(int16_t* buf, unsigned& count)
 {
     int err = 0;
     const char* errmsg;
@@ -1506,14 +2105,29 @@ int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
 
         case 0x11:
         case 0x12:
-            err = sega_execute( m_emulator, 0x7FFFFFFF, buf, &count );
+            if (m_dspMode == DspValidate && buf)
+                err = sega_execute_checked( buf, count );
+            else
+                err = sega_execute( m_emulator, 0x7FFFFFFF, buf, &count );
             break;
 
         case 0x21:
-            errmsg = usf_render_resampled( m_emulator, buf, count, 44100 );
+        {
+            QElapsedTimer timer;
+            timer.start();
+            errmsg = usf_render_resampled( m_emulator, buf, count, sampleRate );
+            if (errmsg && m_usfCore != UsfInterpreter) {
+                qCWarning(XSF_INPUT) << "USF CPU core failed:" << errmsg << "- falling back to the interpreter";
+                if (usf_fall_back())
+                    errmsg = usf_render_resampled( m_emulator, buf, count, sampleRate );
+            }
+            m_usfRenderTime += timer.nsecsElapsed();
             if (errmsg) {
                 err = -1;
+            } else {
+                m_usfFrames += count;
             }
+        }
             break;
 
         case 0x22:
@@ -1523,47 +2137,37 @@ int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
 
             unsigned long frames_to_render = count;
 
-            do {
-                unsigned long frames_rendered = rstate->buffered;
-
-                if ( frames_rendered >= frames_to_render ) {
-                    if (buf) memcpy( buf, rstate->samples, frames_to_render * 4 );
-                    frames_rendered -= frames_to_render;
-                    memcpy( rstate->samples, rstate->samples + frames_to_render * 2, frames_rendered * 4 );
-                    frames_to_render = 0;
-                } else {
-                    if (buf) {
-                        memcpy( buf, rstate->samples, frames_rendered * 4 );
-                        buf = (int16_t *)(((uint8_t *) buf) + frames_rendered * 4);
-                    }
-                    frames_to_render -= frames_rendered;
-                    frames_rendered = 0;
-                }
-                rstate->buffered = (int) frames_rendered;
-
-                if (frames_to_render) {
-                    while ( !rstate->buffered )
-                        core->runFrame(core);
+            /* Frames parked by the last call come first */
+            while ( frames_to_render && rstate->read_pos != rstate->write_pos ) {
+                unsigned long pos = rstate->read_pos % GsfRingLen;
+                unsigned long run = std::min( { frames_to_render, rstate->write_pos - rstate->read_pos, GsfRingLen - pos } );
+                if (buf) {
+                    memcpy( buf, rstate->samples + pos * 2, run * 4 );
+                    buf += run * 2;
                 }
+                rstate->read_pos += run;
+                frames_to_render -= run;
             }
-            while (frames_to_render);
-            count -= (unsigned) frames_to_render;
+
+            rstate->out = buf;
+            rstate->wanted = frames_to_render;
+            while ( rstate->wanted )
+                core->runFrame(core);
+            rstate->out = nullptr;
         }
             break;
 
         case 0x23:
         {
             s9x_BUFFER *buffer = (s9x_BUFFER *) m_emulator;
-            unsigned bytes = count << 2;
-            unsigned offset = 0;
+            unsigned done = 0;
             unsigned giveup = 60 * 30;
-            while (bytes) {
-                unsigned remain = buffer->fil - buffer->cur;
+            while (done < count) {
+                unsigned remain = buffer->Available();
                 while (!remain) {
-                    buffer->cur = buffer->fil = 0;
                     buffer->Fill();
 
-                    remain = buffer->fil - buffer->cur;
+                    remain = buffer->Available();
                     if(!remain) {
                         if(giveup)
                             --giveup;
@@ -1573,16 +2177,16 @@ int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
                 }
                 if(!remain)
                     break;
-                unsigned len = remain;
-                if (len > bytes)
-                    len = bytes;
-                if (buf)
-                    std::copy_n(&buffer->buf[buffer->cur], len, &((uint8_t *)buf)[offset]);
-                bytes -= len;
-                offset += len;
-                buffer->cur += len;
+                unsigned len = std::min(remain, count - done);
+                if (buf) {
+                    buffer->Mix((uint8_t *)(buf + done * 2), len);
+                } else {
+                    len = std::min(len, (unsigned) BufferLen);
+                    buffer->Mix(&buffer->buf[0], len);
+                }
+                done += len;
             }
-            count = offset >> 2;
+            count = done;
         }
             break;
 
@@ -1600,6 +2204,7 @@ int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
             } else {
                 state_render( (NDS_state *)m_emulator, buf, count );
             }
+            m_twosfFrames += count;
             break;
 
         case 0x25:
@@ -1630,31 +2235,305 @@ int XSFDecoder::emu_render(int16_t* buf, unsigned& count)
     return err;
 }
 
+/* Renders with the DSP dynarec, then again with the interpreter from the
+ * same state, and compares the two. The interpreter's output and state are
+ * the ones kept. The first divergence is reported, and the rest of the
+ * track falls back to the interpreter.
+ */
+int XSFDecoder::sega_execute_checked(int16_t* buf, unsigned& count)
+{
+    const size_t size = sega_get_state_size(m_version - 0x10);
+    m_dspCheckState.assign((const uint8_t *) m_emulator, (const uint8_t *) m_emulator + size);
+    m_dspCheckBuffer.resize(count * 2);
+
+    unsigned fastCount = count;
+    const int fastErr = sega_execute( m_emulator, 0x7FFFFFFF, m_dspCheckBuffer.data(), &fastCount );
+
+    memcpy(m_emulator, m_dspCheckState.data(), size);
+    sega_enable_dsp_dynarec(m_emulator, 0);
+    const int err = sega_execute( m_emulator, 0x7FFFFFFF, buf, &count );
+
+    uint64_t mismatches = 0;
+    const unsigned frames = std::min(count, fastCount);
+    for (unsigned i = 0; i < frames * 2; ++i) {
+        const int error = std::abs(buf[i] - m_dspCheckBuffer[i]);
+        if (error) {
+            ++mismatches;
+            m_dspCheckMaxError = std::max(m_dspCheckMaxError, error);
+        }
+    }
+    mismatches += (uint64_t)(std::max(count, fastCount) - frames) * 2;
+    if ((fastErr < 0) != (err < 0))
+        mismatches = std::max<uint64_t>(mismatches, 1);
+
+    if (mismatches) {
+        qCWarning(XSF_INPUT) << "DSP dynarec diverged from the interpreter after" << m_dspCheckFrames
+                             << "frames, largest difference" << m_dspCheckMaxError << "- falling back to the interpreter";
+        m_dspMode = DspInterpreter;
+    } else {
+        sega_enable_dsp_dynarec(m_emulator, 1);
+    }
+
+    m_dspCheckMismatches += mismatches;
+    m_dspCheckFrames += count;
+    return err;
+}
+
+/* Restarts USF on the interpreter and replays it up to where the failed
+ * render started. The rest of the track stays on the interpreter.
+ */
+bool XSFDecoder::usf_fall_back()
+{
+    m_usfCore = UsfInterpreter;
+    usf_restart(m_emulator);
+#ifdef XSF_USF_CPU_CORE
+    usf_set_cpu_core(m_emulator, UsfInterpreter);
+#endif
+
+    uint64_t done = 0;
+    while (done < m_usfFrames) {
+        const size_t frames = (size_t)std::min<uint64_t>(m_usfFrames - done, BufferLen);
+        if (usf_render_resampled( m_emulator, NULL, frames, sampleRate ))
+            return false;
+        done += frames;
+    }
+    return true;
+}
+
+/* While seeking, skips the parts of mixing whose only effect is on the
+ * output: reverb and effects, and sample interpolation. Voice, envelope and
+ * sequencer state still advance as usual. Effect tails heard right after
+ * a seek may be cut short or stale, so this is optional.
+ */
+void XSFDecoder::emu_fast_forward(bool enable)
+{
+    switch (m_version)
+    {
+        case 1:
+        case 2:
+            spu_enable_reverb(iop_get_spu_state(psx_get_iop_state(m_emulator)), !enable);
+            break;
+
+        case 0x11:
+        case 0x12:
+            sega_enable_dsp(m_emulator, !enable);
+            break;
+
+        case 0x24:
+            ((NDS_state *)m_emulator)->dwInterpolation = enable ? 0 : QualitySettings[m_quality].twosfInterpolation;
+            break;
+
+        case 0x25:
+            ((Player *)m_emulator)->interpolation = enable ? INTERPOLATION_NONE : QualitySettings[m_quality].ncsfInterpolation;
+            break;
+    }
+}
+
+/* Captures the running core. Only cores whose state is a single flat block,
+ * or that serialize themselves, are supported. USF, SNSF, 2SF and NCSF keep
+ * parts of their machines in heap memory their libraries allocate and own,
+ * and none of those libraries can save it.
+ */
+bool XSFDecoder::emu_save(std::vector<uint8_t>& state)
+{
+    size_t size;
+    switch (m_version)
+    {
+        case 1:
+        case 2:
+            size = psx_get_state_size(m_version);
+            break;
+
+        case 0x11:
+        case 0x12:
+            size = sega_get_state_size(m_version - 0x10);
+            break;
+
+        case 0x22:
+        {
+            struct mCore * core = ( struct mCore * ) m_emulator;
+            struct gsf_running_state * rstate = ( struct gsf_running_state * ) m_emulatorExtra;
+
+            /* Frames parked in the ring go along with it */
+            size = core->stateSize(core);
+            state.resize(size + gsf_ring_state_size);
+            if (!core->saveState(core, state.data()))
+                return false;
+            memcpy(state.data() + size, &rstate->read_pos, gsf_ring_state_size);
+            return true;
+        }
+
+        case 0x41:
+            size = qsound_get_state_size();
+            break;
+
+        default:
+            return false;
+    }
+    state.assign((const uint8_t *) m_emulator, (const uint8_t *) m_emulator + size);
+    /* Cores at a fixed rate stop mid-filter; the converter goes along */
+    if (m_resampler.active())
+        m_resampler.save(state);
+    return true;
+}
+
+bool XSFDecoder::emu_restore(const std::vector<uint8_t>& state)
+{
+    size_t size;
+    switch (m_version)
+    {
+        case 0x22:
+        {
+            struct mCore * core = ( struct mCore * ) m_emulator;
+            struct gsf_running_state * rstate = ( struct gsf_running_state * ) m_emulatorExtra;
+
+            /* loadState reads stateSize bytes, whatever the vector holds */
+            size = core->stateSize(core);
+            if (state.size() != size + gsf_ring_state_size)
+                return false;
+            if (!core->loadState(core, state.data()))
+                return false;
+            memcpy(&rstate->read_pos, state.data() + size, gsf_ring_state_size);
+            return true;
+        }
+
+        case 1: case 2:
+            size = psx_get_state_size(m_version);
+            break;
+
+        case 0x11:
+        case 0x12:
+            size = sega_get_state_size(m_version - 0x10);
+            break;
+
+        case 0x41:
+            size = qsound_get_state_size();
+            break;
+
+        default:
+            return false;
+    }
+
+    if (state.size() < size)
+        return false;
+    if (m_resampler.active() ? !m_resampler.load(state.data() + size, state.size() - size) : state.size() != size)
+        return false;
+    memcpy(m_emulator, state.data(), size);
+    /* The state may predate a fallback to the interpreter */
+    if (m_version == 0x11 || m_version == 0x12)
+        sega_enable_dsp_dynarec(m_emulator, m_dspMode != DspInterpreter);
+    return true;
+}
+
+/* frame is the output position the core has rendered up to */
+void XSFDecoder::take_snapshot(long frame)
+{
+    if (!m_snapshots.due(frame))
+        return;
+
+    std::vector<uint8_t> state;
+    if (emu_save(state))
+        m_snapshots.add(frame, std::move(state));
+    else
+        m_snapshots.reset(0, 0);
+}
+
+/* The on-disk seek cache only holds states that can be restored into a
+ * core created by another process: mGBA's serialized GBA state. The flat
+ * state blocks of the other cores hold host pointers.
+ */
+void XSFDecoder::open_seek_cache()
+{
+    m_seekFile.close();
+    m_seekCachePath.clear();
+
+    m_seekCacheLimit = (uint64_t)m_settings.value(SeekCache, DefaultSeekCache).toInt() * 1024 * 1024;
+    if (!m_seekCacheLimit || m_version != 0x22 || !m_snapshots.enabled())
+        return;
+
+    std::vector<psf_section_ref> sections;
+    if (psf_load_sections(m_path.toUtf8().constData(), m_version, sections, nullptr, nullptr, 0, nullptr, nullptr) < 0)
+        return;
+
+    /* Keyed by content, so renamed or copied files share an entry, and by
+     * the mGBA build, whose states no other build should load. Snapshot
+     * positions are counted at the output rate. */
+    struct mCore * core = ( struct mCore * ) m_emulator;
+    m_seekStateSize = core->stateSize(core) + gsf_ring_state_size;
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    const uint32_t header[4] = { (uint32_t) m_version, (uint32_t) sections.size(), (uint32_t) sampleRate, (uint32_t) m_seekStateSize };
+    hash.addData(QByteArrayView(header, sizeof(header)));
+    hash.addData(QByteArrayView(projectVersion, (qsizetype) strlen(projectVersion)));
+    hash.addData(QByteArrayView(gitCommit, (qsizetype) strlen(gitCommit)));
+    for (const psf_section_ref & section : sections) {
+        hash.addData(QByteArrayView(section->reserved.data(), (qsizetype) section->reserved.size()));
+        hash.addData(QByteArrayView(section->program.data(), (qsizetype) section->program.size()));
+    }
+
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + u"/xsf-seek"_s;
+    if (!QDir{}.mkpath(dir))
+        return;
+
+    m_seekCacheDir = dir.toUtf8().constData();
+    m_seekCachePath = m_seekCacheDir + "/" + hash.result().toHex().constData() + ".seek";
+    m_seekFile.open(m_seekCachePath, m_seekStateSize);
+}
+
+/* Writes the track's snapshots back if they reach further than the file */
+void XSFDecoder::save_seek_cache()
+{
+    if (m_seekCachePath.empty() || m_snapshots.last_frame() <= m_seekFile.last_frame())
+        return;
+
+    if (snapshot_file::write(m_seekCachePath, m_snapshots.snapshots())) {
+        snapshot_cache_trim(m_seekCacheDir, m_seekCacheLimit);
+        m_seekFile.open(m_seekCachePath, m_seekStateSize);
+    }
+}
+
 std::optional<Fooyin::AudioFormat> XSFDecoder::init(const Fooyin::AudioSource& source, const Fooyin::Track& track, DecoderOptions options)
 {
     repeatOne = !(options & NoInfiniteLooping) && isRepeatingTrack();
 
     /* Must call here, with possible m_version already set, in case something is
      * cleaning up a completely different PSF format than the one we're now opening.
+     * Reopening the same track only rewinds the running core, unless stop()
+     * already left it at the start.
      */ 
-    emu_cleanup();
+    const int outputRate = m_settings.value(OutputRate, DefaultOutputRate).toInt();
+    const int dspMode = dspModeSetting(m_settings.value(DspMode, DefaultDspMode).toInt());
+    const int usfCore = usfCoreSetting(m_settings.value(UsfCore, DefaultUsfCore).toInt());
+    const int quality = std::clamp(m_settings.value(Quality, DefaultQuality).toInt(), (int)QualityLowPower, (int)QualityReference);
+    const bool restarted = track.filepath() == m_path && outputRate == m_outputRate && dspMode == m_dspMode
+                        && usfCore == m_usfCore && quality == m_quality
+                        && ((m_emulator && framesRead == 0 && !m_aheadThread.joinable()) || emu_restart());
+    /* Cleanup still sees the settings the old track ran with, so its logs
+     * name the core that rendered it */
+    if(!restarted)
+        emu_cleanup();
+    m_outputRate = outputRate;
+    m_dspMode = dspMode;
+    m_usfCore = usfCore;
+    m_quality = quality;
 
     if(track.isInArchive()) {
         return {};
     }
 
     m_path = track.filepath();
+    m_track = track;
 
     struct psf_info_meta_state info_state;
     memset(&info_state, 0, sizeof(info_state));
-    
-    int psf_version = psf_load(m_path.toUtf8().constData(), &psf_file_system, 0, 0, 0, psf_info_meta, &info_state, 0, psf_error_log, 0);
+
+    /* Only the header and top level tags are needed here; the single full
+     * load of the file and its _lib chain happens in emu_init.
+     */
+    int psf_version = psf_read_tags(m_path.toUtf8().constData(), psf_info_meta, &info_state);
     if(psf_version < 0) {
         return {};
     }
 
-    free_tags(info_state.tags);
-
     switch(psf_version) {
         case 1:
         case 2:
@@ -1676,11 +2555,21 @@ std::optional<Fooyin::AudioFormat> XSFDecoder::init(const Fooyin::AudioSource& s
     if(sampleRate < 0) {
         return {};
     }
+    if(m_outputRate > 0)
+        sampleRate = m_outputRate;
 
-    m_version = psf_version;
+    totalFrames = 0;
+    m_silenceStop = 0;
+    m_silenceEnd = -1;
+    m_silenceApplied = false;
 
-    if(emu_init() < 0) {
-        return {};
+    if(!restarted) {
+        m_version = psf_version;
+        m_image.reset();
+
+        if(emu_init() < 0) {
+            return {};
+        }
     }
 
     m_format.setSampleRate(sampleRate);
@@ -1691,12 +2580,22 @@ std::optional<Fooyin::AudioFormat> XSFDecoder::init(const Fooyin::AudioSource& s
     if(!tag_song_ms) {
         tag_song_ms = m_settings.value(MaxLength, DefaultMaxLength).toInt() * 60 * 1000;
         tag_fade_ms = m_settings.value(FadeLength, DefaultFadeLength).toInt();
+        if(!repeatOne)
+            m_silenceStop = sampleRate * m_settings.value(SilenceLength, DefaultSilenceLength).toInt();
     }
 
     framesLength = m_format.framesForDuration(tag_song_ms);
     framesFade = m_format.framesForDuration(tag_fade_ms);
     totalFrames = framesLength + framesFade;
 
+    m_aheadLength = m_format.framesForDuration(m_settings.value(RenderAhead, DefaultRenderAhead).toInt());
+    m_fastSeek = m_settings.value(FastSeek, DefaultFastSeek).toBool();
+
+    if(!restarted) {
+        m_snapshots.reset((size_t)m_settings.value(SeekBudget, DefaultSeekBudget).toInt() * 1024 * 1024, SnapshotSeconds * sampleRate);
+        open_seek_cache();
+    }
+
     return m_format;
 }
  
@@ -1707,16 +2606,63 @@ void XSFDecoder::start()
 
 void XSFDecoder::stop()
 {
-    emu_cleanup();
+    /* The worker takes snapshots as it renders */
+    stop_render_ahead();
+
+    save_seek_cache();
+
+    /* A looping track keeps a core that can be rewound, so replaying it is
+     * free. Otherwise an idle decoder would only pin the core, its initial
+     * state or spare, and the image. */
+    m_snapshots.clear();
+    if(!repeatOne || !emu_restart(false)) {
+        emu_cleanup();
+        framesRead = -1;
+    }
     m_changedTrack = {};
-    framesRead = -1;
     m_isDecoding = false;
 }
 
 void XSFDecoder::seek(uint64_t pos)
 {
     uint64_t framesTarget = m_format.framesForDuration(pos);
-    if(framesTarget < framesRead) {
+
+    if(m_aheadThread.joinable()) {
+        /* Short forward seeks are served from the audio already queued */
+        if(framesTarget >= (uint64_t)framesRead && framesTarget - framesRead <= m_aheadRing.available() / 2) {
+            m_aheadRing.skip((framesTarget - framesRead) * 2);
+            framesRead = (long)framesTarget;
+            {
+                std::lock_guard<std::mutex> lock(m_aheadLock);
+            }
+            m_aheadWake.notify_all();
+            return;
+        }
+        stop_render_ahead();
+    }
+
+    /* Restore the nearest state before the target, unless the core is
+     * already closer to it */
+    const emu_snapshot* snapshot = m_snapshots.find((long)framesTarget);
+    const snapshot_cache_entry* cached = m_seekFile.find((long)framesTarget);
+    const long position = framesRead + (long)silence_test_buffer.data_available() / 2;
+    bool restored = false;
+    if(cached && (!snapshot || cached->frame > snapshot->frame)
+       && (framesTarget < framesRead || cached->frame > position)) {
+        std::vector<uint8_t> state;
+        if(m_seekFile.read(*cached, state) && emu_restore(state)) {
+            framesRead = cached->frame;
+            restored = true;
+        }
+    }
+    if(!restored && snapshot && (framesTarget < framesRead || snapshot->frame > position)
+       && emu_restore(snapshot->state)) {
+        framesRead = snapshot->frame;
+        restored = true;
+    }
+    if(restored) {
+        silence_test_buffer.reset();
+    } else if(framesTarget < framesRead && !emu_restart()) {
         emu_cleanup();
         emu_init();
         if(usfRemoveSilence) {
@@ -1736,6 +2682,10 @@ void XSFDecoder::seek(uint64_t pos)
         framesRead += buffered_samples;
     }
 
+    const bool fastForward = m_fastSeek && framesRead < framesTarget;
+    if(fastForward)
+        emu_fast_forward(true);
+
     while(framesRead < framesTarget) {
         unsigned toSkip = BufferLen;
         if(toSkip > framesTarget - framesRead) toSkip = (unsigned)(framesTarget - framesRead);
@@ -1744,6 +2694,9 @@ void XSFDecoder::seek(uint64_t pos)
         }
         framesRead += toSkip;
     }
+
+    if(fastForward)
+        emu_fast_forward(false);
 }
 
 Fooyin::AudioBuffer XSFDecoder::readBuffer(size_t bytes)
@@ -1752,22 +2705,49 @@ Fooyin::AudioBuffer XSFDecoder::readBuffer(size_t bytes)
         return {};
     }
 
+    /* The track ends where its trailing silence began, or here if that
+     * has already been played */
+    const long silenceEnd = m_silenceEnd;
+    if(!m_silenceApplied && silenceEnd >= 0 && silenceEnd < totalFrames) {
+        m_silenceApplied = true;
+        totalFrames = std::max(silenceEnd, framesRead);
+        if(framesLength > totalFrames)
+            framesLength = totalFrames;
+        m_changedTrack = m_track;
+        m_changedTrack.setDuration(static_cast<uint64_t>(m_format.durationForFrames(totalFrames)));
+        qCDebug(XSF_INPUT) << "Trailing silence, track ends at" << m_changedTrack.duration() << "ms";
+    }
+
     if(!repeatOne && framesRead >= totalFrames)
     {
         return {};
     }
 
-    if(!m_emulator) {
+    /* Once leading silence is trimmed and nothing watches for trailing
+     * silence, the silence buffer is only drained, and the emulator
+     * renders straight into the output buffer. */
+    const bool direct = m_emulator && !usfRemoveSilence && !m_silenceStop;
+
+    if(m_aheadThread.joinable()) {
+        if(m_aheadEnded && !m_aheadRing.available())
+            return {};
+    } else if(!m_emulator) {
         if(emu_init() < 0)
             return {};
-    } else if(!fill_buffer())
-        return {};
+    } else {
+        take_snapshot(framesRead + (long)silence_test_buffer.data_available() / 2);
+        if(!direct && !fill_buffer(framesRead, totalFrames))
+            return {};
+    }
 
     if(usfRemoveSilence) {
         silence_test_buffer.remove_leading_silence();
         usfRemoveSilence = false;
     }
 
+    if(m_aheadLength > 0 && !m_aheadThread.joinable())
+        start_render_ahead();
+
     const auto startTime = static_cast<uint64_t>(m_format.durationForFrames(framesRead));
 
     AudioBuffer buffer{m_format, startTime};
@@ -1776,15 +2756,33 @@ Fooyin::AudioBuffer XSFDecoder::readBuffer(size_t bytes)
     const int frames = m_format.framesForBytes(static_cast<int>(bytes));
     int framesWritten{0};
     while(framesWritten < frames) {
+        if(m_aheadThread.joinable()) {
+            int16_t* framesOut = (int16_t *)(buffer.data() + m_format.bytesForFrames(framesWritten));
+            size_t read = read_ahead(framesOut, frames - framesWritten);
+            if(!read)
+                break;
+            framesWritten += (int)read;
+            continue;
+        }
         unsigned long written = silence_test_buffer.data_available() / 2;
+        const int bufferPos     = m_format.bytesForFrames(framesWritten);
+        int16_t* framesOut = (int16_t *)(buffer.data() + bufferPos);
+        if(!written && direct) {
+            long framesLeft = frames - framesWritten;
+            if(!repeatOne && framesLeft > totalFrames - framesRead - framesWritten)
+                framesLeft = totalFrames - framesRead - framesWritten;
+            unsigned count = (unsigned)framesLeft;
+            if(framesLeft <= 0 || emu_render(framesOut, count) < 0)
+                break;
+            framesWritten += count;
+            continue;
+        }
         if(!written) {
-            if(!fill_buffer())
+            if(!fill_buffer(framesRead, totalFrames))
                 break;
             continue;
         }
         unsigned framesToWrite = std::min(frames - framesWritten, (int)written);
-        const int bufferPos     = m_format.bytesForFrames(framesWritten);
-        int16_t* framesOut = (int16_t *)(buffer.data() + bufferPos);
         silence_test_buffer.read(framesOut, framesToWrite * 2);
         framesWritten += framesToWrite;
     }
@@ -1796,10 +2794,10 @@ Fooyin::AudioBuffer XSFDecoder::readBuffer(size_t bytes)
             long fadeEnd = (framesRead + framesWritten > totalFrames) ? totalFrames : (framesRead + framesWritten);
             long fadePos;
 
-            int16_t* buff = (int16_t *)(buffer.data()) + fadeStart - framesRead;
+            int16_t* buff = (int16_t *)(buffer.data()) + (fadeStart - framesRead) * 2;
 
             float fadeScale = (float)(framesFade - (fadeStart - framesLength)) / framesFade;
-            float fadeStep = 1.0f / (float)framesFade;
+            float fadeStep = -1.0f / (float)framesFade;
             for(fadePos = fadeStart; fadePos < fadeEnd; ++fadePos)
             {
                 buff[0] *= fadeScale;
@@ -1851,11 +2849,19 @@ bool XSFReader::readTrack(const AudioSource& source, Track& track)
 
     QString path = track.filepath();
 
-    int psf_version = psf_load( path.toUtf8().constData(), &psf_file_system, 0, 0, 0, psf_info_meta, &state, 0, psf_error_log, 0 );
+    /* Only top level tags are shown, so neither the program section nor
+     * any _lib file has to be read.
+     */
+    psf_tag_arena tags;
+    int psf_version = psf_read_tag_arena( path.toUtf8().constData(), tags );
     if(psf_version < 0) {
         return false;
     }
 
+    for(size_t i = 0; i < tags.size(); ++i) {
+        psf_info_meta( &state, tags.name(i), tags.value(i) );
+    }
+
     const FySettings settings;
  
     int tag_song_ms = state.tag_song_ms;
@@ -1878,48 +2884,50 @@ bool XSFReader::readTrack(const AudioSource& source, Track& track)
     track.setChannels(2);
     track.setEncoding(u"Synthesized"_s);
 
-    struct psf_tag * tag = state.tags;
-    while( tag ) {
+    for(size_t i = 0; i < tags.size(); ++i) {
+        const char * tag_name = psf_meta_name( tags.name(i) );
+        if( !tag_name ) {
+            continue;
+        }
+        const char * tag_value = tags.value(i);
+
         QString name, value;
         if( state.utf8 ) {
-            name = QString::fromUtf8(tag->name);
-            value = QString::fromUtf8(tag->value);
+            name = QString::fromUtf8(tag_name);
+            value = QString::fromUtf8(tag_value);
         } else {
-            name = QString::fromLocal8Bit(tag->name);
-            value = QString::fromLocal8Bit(tag->value);
+            name = QString::fromLocal8Bit(tag_name);
+            value = QString::fromLocal8Bit(tag_value);
         }
-        if(!strcasecmp(tag->name, "TITLE")) {
+        if(!strcasecmp(tag_name, "TITLE")) {
             track.setTitle(value);
-        } else if(!strcasecmp(tag->name, "ARTIST")) {
+        } else if(!strcasecmp(tag_name, "ARTIST")) {
             track.setArtists({value});
-        } else if(!strcasecmp(tag->name, "ALBUM")) {
+        } else if(!strcasecmp(tag_name, "ALBUM")) {
             track.setAlbum(value);
-        } else if(!strcasecmp(tag->name, "DATE")) {
+        } else if(!strcasecmp(tag_name, "DATE")) {
             track.setDate(value);
-        } else if(!strcasecmp(tag->name, "GENRE")) {
+        } else if(!strcasecmp(tag_name, "GENRE")) {
             track.setGenres({value});
-        } else if(!strcasecmp(tag->name, "COMMENT")) {
+        } else if(!strcasecmp(tag_name, "COMMENT")) {
             track.setComment({value});
-        } else if(!strncasecmp(tag->name, "REPLAYGAIN_", 11)) {
+        } else if(!strncasecmp(tag_name, "REPLAYGAIN_", 11)) {
             char* end;
-            float fval = strtod(tag->value, &end);
-            if(!strcasecmp(tag->name + 11, "ALBUM_GAIN")) {
+            float fval = strtod(tag_value, &end);
+            if(!strcasecmp(tag_name + 11, "ALBUM_GAIN")) {
                 track.setRGAlbumGain(fval);
-            } else if(!strcasecmp(tag->name + 11, "ALBUM_PEAK")) {
+            } else if(!strcasecmp(tag_name + 11, "ALBUM_PEAK")) {
                 track.setRGAlbumPeak(fval);
-            } else if(!strcasecmp(tag->name + 11, "TRACK_GAIN")) {
+            } else if(!strcasecmp(tag_name + 11, "TRACK_GAIN")) {
                 track.setRGTrackGain(fval);
-            } else if(!strcasecmp(tag->name + 11, "TRACK_PEAK")) {
+            } else if(!strcasecmp(tag_name + 11, "TRACK_PEAK")) {
                 track.setRGTrackPeak(fval);
             }
         } else {
             track.addExtraTag(name, value);
         }
-        tag = tag->next;
     }
 
-    free_tags( state.tags );
- 
     return true;
 }
 } // namespace Fooyin::XSFInput
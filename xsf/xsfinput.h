@@ -23,12 +23,26 @@
 #include <fooyin/core/engine/audioinput.h>
 
 #include "circular_buffer.h"
+#include "resampler.h"
+#include "snapshot_cache.h"
+#include "snapshot_index.h"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace Fooyin::XSFInput {
+struct xsf_image;
+
 class XSFDecoder : public Fooyin::AudioDecoder
 {
 public:
     XSFDecoder();
+    ~XSFDecoder() override;
 
     [[nodiscard]] QStringList extensions() const override;
     [[nodiscard]] bool isSeekable() const override;
@@ -44,11 +58,29 @@ public:
     Fooyin::AudioBuffer readBuffer(size_t bytes) override;
 
 private:
+    int emu_load();
     int emu_init();
+    bool emu_restart(bool prepare = true);
+    void start_twosf_spare();
+    void drop_twosf_spare();
     int emu_render(int16_t* buf, unsigned& pairs);
+    int emu_render_core(int16_t* buf, unsigned& pairs);
+    void emu_fast_forward(bool enable);
+    int sega_execute_checked(int16_t* buf, unsigned& count);
+    bool usf_fall_back();
     void emu_cleanup();
+    bool emu_save(std::vector<uint8_t>& state);
+    bool emu_restore(const std::vector<uint8_t>& state);
 
-    bool fill_buffer();
+    bool fill_buffer(long position, long total);
+    void take_snapshot(long frame);
+    void open_seek_cache();
+    void save_seek_cache();
+
+    void start_render_ahead();
+    void stop_render_ahead();
+    void render_ahead();
+    size_t read_ahead(int16_t* out, size_t frames);
 
     Fooyin::FySettings m_settings;
     Fooyin::AudioFormat m_format;
@@ -56,19 +88,77 @@ private:
     int m_version;
     void* m_emulator;
     void* m_emulatorExtra;
+    std::shared_ptr<const xsf_image> m_image;
     Fooyin::Track m_changedTrack;
     bool m_isDecoding;
 
     bool usfRemoveSilence;
+    /* Output rate; cores without a rate of their own are converted to it */
     int sampleRate;
+    int m_outputRate;
+    polyphase_resampler m_resampler;
+    std::vector<int16_t> m_resampleInput;
     long silenceSeconds;
     circular_buffer<int16_t> silence_test_buffer;
+    snapshot_index m_snapshots;
+    /* The core and silence buffer as emu_init left them */
+    std::vector<uint8_t> m_initState;
+    circular_buffer<int16_t> m_initBuffer;
+    polyphase_resampler m_initResampler;
+    /* 2SF cannot save its state; restarts swap in a spare core advanced by
+     * as many frames as emu_init rendered. The first restart builds one;
+     * while looping, the next is built in the background. */
+    std::future<void*> m_twosfSpare;
+    std::atomic<bool> m_twosfCancel;
+    unsigned long m_twosfFrames;
+    unsigned long m_twosfInitFrames;
+    /* Snapshots kept on disk from earlier plays of the same track */
+    std::string m_seekCacheDir;
+    std::string m_seekCachePath;
+    uint64_t m_seekCacheLimit;
+    size_t m_seekStateSize;
+    snapshot_file m_seekFile;
 
     bool repeatOne;
+    bool m_fastSeek;
+    /* SSF/DSF DSP mode, and what validation has found so far */
+    int m_dspMode;
+    std::vector<uint8_t> m_dspCheckState;
+    std::vector<int16_t> m_dspCheckBuffer;
+    uint64_t m_dspCheckFrames;
+    uint64_t m_dspCheckMismatches;
+    int m_dspCheckMaxError;
+    /* USF CPU core, and its throughput for the log */
+    int m_usfCore;
+    uint64_t m_usfFrames;
+    int64_t m_usfRenderTime;
+    /* Quality profile, and how fast the track renders with it */
+    int m_quality;
+    uint64_t m_renderFrames;
+    int64_t m_renderTime;
+    Fooyin::Track m_track;
+    /* Untagged tracks end after m_silenceStop frames of silence; the
+     * frame that silence started at is published in m_silenceEnd. */
+    long m_silenceStop;
+    std::atomic<long> m_silenceEnd;
+    bool m_silenceApplied;
     long totalFrames;
 	long framesLength;
 	long framesFade;
 	long framesRead;
+
+    /* Render-ahead: while m_aheadThread runs, it owns the emulator and the
+     * silence buffer, and readBuffer only copies out of m_aheadRing. */
+    long m_aheadLength;
+    long m_aheadFrames;
+    /* totalFrames as it was at the start; later cuts come via m_silenceEnd */
+    long m_aheadTotal;
+    std::thread m_aheadThread;
+    std::atomic<bool> m_aheadStop;
+    std::atomic<bool> m_aheadEnded;
+    std::mutex m_aheadLock;
+    std::condition_variable m_aheadWake;
+    spsc_ring<int16_t> m_aheadRing;
 };
  
 class XSFReader : public AudioReader
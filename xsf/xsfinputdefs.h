@@ -24,5 +24,81 @@ constexpr auto DefaultMaxLength     = 3.0;
 constexpr auto MaxLength            = "XSFInput/MaxLength";
 constexpr auto DefaultFadeLength    = 4000;
 constexpr auto FadeLength           = "XSFInput/FadeLength";
+constexpr auto DefaultRenderAhead   = 0;
+constexpr auto RenderAhead          = "XSFInput/RenderAhead";
+constexpr auto DefaultSilenceLength = 5;
+constexpr auto SilenceLength        = "XSFInput/SilenceLength";
+constexpr auto DefaultSeekBudget    = 64;
+constexpr auto SeekBudget           = "XSFInput/SeekBudget";
+constexpr auto DefaultSeekCache     = 0;
+constexpr auto SeekCache            = "XSFInput/SeekCache";
+constexpr auto DefaultFastSeek      = true;
+constexpr auto FastSeek             = "XSFInput/FastSeek";
+constexpr auto DefaultOutputRate    = 0;
+constexpr auto OutputRate           = "XSFInput/OutputRate";
+constexpr auto DefaultDspMode       = 0;
+constexpr auto DspMode              = "XSFInput/DspMode";
+
+/* How SSF and DSF run the SCSP/AICA effect DSP */
+enum DspModes : int
+{
+    DspInterpreter = 0,
+    DspDynarec,
+    /* Dynarec, checked against the interpreter */
+    DspValidate,
+};
+
+/* The SCSP/AICA DSP dynarec emits x86-64 code; other hosts interpret */
+#if defined(__x86_64__) || defined(_M_X64)
+constexpr bool DspDynarecSupported = true;
+#else
+constexpr bool DspDynarecSupported = false;
+#endif
+
+/* A stored mode this build cannot run loads as the interpreter */
+constexpr int dspModeSetting(int mode)
+{
+    return DspDynarecSupported && mode >= DspInterpreter && mode <= DspValidate ? mode : DspInterpreter;
+}
+
+constexpr auto DefaultUsfCore       = 0;
+constexpr auto UsfCore              = "XSFInput/UsfCore";
+
+/* The r4300 core USF runs on, numbered as lazyusf2 numbers them */
+enum UsfCores : int
+{
+    UsfInterpreter = 0,
+    UsfCachedInterpreter,
+    UsfRecompiler,
+};
+
+#ifdef XSF_USF_CPU_CORE
+constexpr bool UsfCpuCoreSupported = true;
+#else
+constexpr bool UsfCpuCoreSupported = false;
+#endif
+
+/* Settings are shared between builds; a core this one lacks loads as the
+ * interpreter */
+constexpr int usfCoreSetting(int core)
+{
+    return UsfCpuCoreSupported && core >= UsfInterpreter && core <= UsfRecompiler ? core : UsfInterpreter;
+}
+
+constexpr auto DefaultQuality       = 1;
+constexpr auto Quality              = "XSFInput/Quality";
+
+/* Written by the decoder, for the settings dialog: the format and render
+ * speed of the last track played with each profile, under
+ * RenderSpeed/<profile>/Format and RenderSpeed/<profile>/Speed */
+constexpr auto RenderSpeed          = "XSFInput/RenderSpeed";
+
+/* Interpolation and resampler presets; emulation accuracy is unchanged */
+enum QualityProfiles : int
+{
+    QualityLowPower = 0,
+    QualityBalanced,
+    QualityReference,
+};
 
 } // namespace Fooyin::XSFInput
@@ -22,6 +22,7 @@
 #include "xsfinputdefs.h"
 
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDialogButtonBox>
 #include <QGridLayout>
 #include <QGroupBox>
@@ -38,6 +39,16 @@ XSFInputSettings::XSFInputSettings(QWidget* parent)
     : QDialog{parent}
     , m_maxLength{new QDoubleSpinBox(this)}
     , m_fadeLength{new QSpinBox(this)}
+    , m_silenceLength{new QSpinBox(this)}
+    , m_renderAhead{new QSpinBox(this)}
+    , m_seekBudget{new QSpinBox(this)}
+    , m_seekCache{new QSpinBox(this)}
+    , m_fastSeek{new QCheckBox(tr("Fast seeking"), this)}
+    , m_outputRate{new QComboBox(this)}
+    , m_dspMode{new QComboBox(this)}
+    , m_usfCore{new QComboBox(this)}
+    , m_quality{new QComboBox(this)}
+    , m_renderSpeed{new QLabel(this)}
 {
     setWindowTitle(tr("%1 Settings").arg(u"xSF Input"_s));
     setModal(true);
@@ -61,32 +72,164 @@ XSFInputSettings::XSFInputSettings(QWidget* parent)
     m_fadeLength->setSingleStep(500);
     m_fadeLength->setSuffix(u" "_s + tr("ms"));
 
+    auto* silenceLabel = new QLabel(tr("Stop after silence") + u":"_s, this);
+    silenceLabel->setToolTip(tr("End tracks without a length tag once they have been silent this long"));
+
+    m_silenceLength->setRange(0, 60);
+    m_silenceLength->setSuffix(u" "_s + tr("seconds"));
+    m_silenceLength->setSpecialValueText(tr("Off"));
+
     int row{0};
     lengthLayout->addWidget(maxLengthLabel, row, 0);
     lengthLayout->addWidget(m_maxLength, row++, 1);
     lengthLayout->addWidget(fadeLabel, row, 0);
     lengthLayout->addWidget(m_fadeLength, row++, 1);
+    lengthLayout->addWidget(silenceLabel, row, 0);
+    lengthLayout->addWidget(m_silenceLength, row++, 1);
     lengthLayout->setColumnStretch(2, 1);
     lengthLayout->setRowStretch(row++, 1);
 
+    auto* playbackGroup  = new QGroupBox(tr("Playback"), this);
+    auto* playbackLayout = new QGridLayout(playbackGroup);
+
+    auto* renderAheadLabel = new QLabel(tr("Render ahead") + u":"_s, this);
+    renderAheadLabel->setToolTip(tr("Emulate on a separate thread, this far ahead of playback"));
+
+    m_renderAhead->setRange(0, 5000);
+    m_renderAhead->setSingleStep(250);
+    m_renderAhead->setSuffix(u" "_s + tr("ms"));
+    m_renderAhead->setSpecialValueText(tr("Off"));
+
+    auto* seekBudgetLabel = new QLabel(tr("Seek snapshots") + u":"_s, this);
+    seekBudgetLabel->setToolTip(tr("Memory for emulator states kept during playback, so seeks only emulate from the nearest one"));
+
+    m_seekBudget->setRange(0, 1024);
+    m_seekBudget->setSingleStep(16);
+    m_seekBudget->setSuffix(u" "_s + tr("MB"));
+    m_seekBudget->setSpecialValueText(tr("Off"));
+
+    auto* seekCacheLabel = new QLabel(tr("Seek cache on disk") + u":"_s, this);
+    seekCacheLabel->setToolTip(tr("Keep seek snapshots between plays, for cores that support it"));
+
+    m_seekCache->setRange(0, 4096);
+    m_seekCache->setSingleStep(64);
+    m_seekCache->setSuffix(u" "_s + tr("MB"));
+    m_seekCache->setSpecialValueText(tr("Off"));
+
+    auto* outputRateLabel = new QLabel(tr("Output rate") + u":"_s, this);
+    outputRateLabel->setToolTip(tr("Native keeps each core's own rate; a fixed rate is converted once, inside the plugin"));
+
+    m_outputRate->addItem(tr("Native"), 0);
+    for(const int rate : {44100, 48000, 88200, 96000}) {
+        m_outputRate->addItem(tr("%1 Hz").arg(rate), rate);
+    }
+
+    auto* qualityLabel = new QLabel(tr("Quality") + u":"_s, this);
+    qualityLabel->setToolTip(tr("Interpolation for SNSF, 2SF and NCSF, and the resampler filter used with a fixed "
+                                "output rate. Low power is cheaper to run; reference sounds best. Below is how fast "
+                                "the last track played with the selected profile rendered"));
+
+    m_quality->addItem(tr("Low power"), QualityLowPower);
+    m_quality->addItem(tr("Balanced"), QualityBalanced);
+    m_quality->addItem(tr("Reference"), QualityReference);
+
+    auto* dspModeLabel = new QLabel(tr("SSF/DSF DSP") + u":"_s, this);
+    dspModeLabel->setToolTip(tr("How the Saturn and Dreamcast effect DSP runs. The dynarec is only used on x86-64; "
+                                "validation also runs the interpreter, reports any difference in the log, "
+                                "and falls back to the interpreter"));
+
+    m_dspMode->addItem(tr("Interpreter"), DspInterpreter);
+    if(DspDynarecSupported) {
+        m_dspMode->addItem(tr("Dynarec"), DspDynarec);
+        m_dspMode->addItem(tr("Dynarec, validated"), DspValidate);
+    }
+    m_dspMode->setEnabled(m_dspMode->count() > 1);
+
+    auto* usfCoreLabel = new QLabel(tr("USF CPU") + u":"_s, this);
+    usfCoreLabel->setToolTip(tr("How the N64 CPU runs. Faster cores need a build with XSF_USF_CPU_CORE, "
+                                "and fall back to the interpreter if rendering fails"));
+
+    m_usfCore->addItem(tr("Interpreter"), UsfInterpreter);
+    if(UsfCpuCoreSupported) {
+        m_usfCore->addItem(tr("Cached interpreter"), UsfCachedInterpreter);
+        m_usfCore->addItem(tr("Recompiler"), UsfRecompiler);
+    }
+    m_usfCore->setEnabled(m_usfCore->count() > 1);
+
+    m_fastSeek->setToolTip(tr("Skip reverb, effects and interpolation while seeking. Effect tails may be cut after a seek"));
+
+    row = 0;
+    playbackLayout->addWidget(outputRateLabel, row, 0);
+    playbackLayout->addWidget(m_outputRate, row++, 1);
+    playbackLayout->addWidget(qualityLabel, row, 0);
+    playbackLayout->addWidget(m_quality, row++, 1);
+    playbackLayout->addWidget(m_renderSpeed, row++, 1);
+    playbackLayout->addWidget(dspModeLabel, row, 0);
+    playbackLayout->addWidget(m_dspMode, row++, 1);
+    playbackLayout->addWidget(usfCoreLabel, row, 0);
+    playbackLayout->addWidget(m_usfCore, row++, 1);
+    playbackLayout->addWidget(renderAheadLabel, row, 0);
+    playbackLayout->addWidget(m_renderAhead, row++, 1);
+    playbackLayout->addWidget(seekBudgetLabel, row, 0);
+    playbackLayout->addWidget(m_seekBudget, row++, 1);
+    playbackLayout->addWidget(seekCacheLabel, row, 0);
+    playbackLayout->addWidget(m_seekCache, row++, 1);
+    playbackLayout->addWidget(m_fastSeek, row++, 0, 1, 2);
+    playbackLayout->setColumnStretch(2, 1);
+    playbackLayout->setRowStretch(row++, 1);
+
     auto* layout = new QGridLayout(this);
     layout->setSizeConstraint(QLayout::SetFixedSize);
 
     row = 0;
     layout->addWidget(lengthGroup, row++, 0, 1, 4);
+    layout->addWidget(playbackGroup, row++, 0, 1, 4);
     layout->addWidget(buttons, row++, 0, 1, 4, Qt::AlignBottom);
     layout->setColumnStretch(2, 1);
 
     m_maxLength->setValue(m_settings.value(MaxLength, DefaultMaxLength).toInt());
     m_fadeLength->setValue(m_settings.value(FadeLength, DefaultFadeLength).toInt());
+    m_silenceLength->setValue(m_settings.value(SilenceLength, DefaultSilenceLength).toInt());
+    m_renderAhead->setValue(m_settings.value(RenderAhead, DefaultRenderAhead).toInt());
+    m_seekBudget->setValue(m_settings.value(SeekBudget, DefaultSeekBudget).toInt());
+    m_seekCache->setValue(m_settings.value(SeekCache, DefaultSeekCache).toInt());
+    m_fastSeek->setChecked(m_settings.value(FastSeek, DefaultFastSeek).toBool());
+    m_outputRate->setCurrentIndex(std::max(0, m_outputRate->findData(m_settings.value(OutputRate, DefaultOutputRate).toInt())));
+    m_dspMode->setCurrentIndex(std::max(0, m_dspMode->findData(dspModeSetting(m_settings.value(DspMode, DefaultDspMode).toInt()))));
+    m_usfCore->setCurrentIndex(std::max(0, m_usfCore->findData(usfCoreSetting(m_settings.value(UsfCore, DefaultUsfCore).toInt()))));
+    m_quality->setCurrentIndex(std::max(0, m_quality->findData(m_settings.value(Quality, DefaultQuality).toInt())));
+
+    updateRenderSpeed();
+    QObject::connect(m_quality, &QComboBox::currentIndexChanged, this, &XSFInputSettings::updateRenderSpeed);
 }
  
 void XSFInputSettings::accept()
 {
     m_settings.setValue(MaxLength, m_maxLength->value());
     m_settings.setValue(FadeLength, m_fadeLength->value());
+    m_settings.setValue(SilenceLength, m_silenceLength->value());
+    m_settings.setValue(RenderAhead, m_renderAhead->value());
+    m_settings.setValue(SeekBudget, m_seekBudget->value());
+    m_settings.setValue(SeekCache, m_seekCache->value());
+    m_settings.setValue(FastSeek, m_fastSeek->isChecked());
+    m_settings.setValue(OutputRate, m_outputRate->currentData().toInt());
+    m_settings.setValue(DspMode, m_dspMode->currentData().toInt());
+    m_settings.setValue(UsfCore, m_usfCore->currentData().toInt());
+    m_settings.setValue(Quality, m_quality->currentData().toInt());
 
     done(Accepted);
 }
 
+void XSFInputSettings::updateRenderSpeed()
+{
+    const QString key = QString::fromLatin1(RenderSpeed) + u"/"_s + QString::number(m_quality->currentData().toInt());
+    const QString format = m_settings.value(key + u"/Format"_s).toString();
+    if(format.isEmpty()) {
+        m_renderSpeed->setText(tr("Not measured yet"));
+        return;
+    }
+    const double speed = m_settings.value(key + u"/Speed"_s).toDouble();
+    m_renderSpeed->setText(tr("Last %1 track: %2× realtime").arg(format).arg(speed, 0, 'f', 1));
+}
+
 } // namespace Fooyin::XSFInput
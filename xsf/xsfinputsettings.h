@@ -24,6 +24,8 @@
 #include <QDialog>
 
 class QCheckBox;
+class QComboBox;
+class QLabel;
 class QSpinBox;
 class QDoubleSpinBox;
 
@@ -38,8 +40,20 @@ public:
     void accept() override;
 
 private:
+    void updateRenderSpeed();
+
     FySettings m_settings;
     QDoubleSpinBox* m_maxLength;
     QSpinBox* m_fadeLength;
+    QSpinBox* m_silenceLength;
+    QSpinBox* m_renderAhead;
+    QSpinBox* m_seekBudget;
+    QSpinBox* m_seekCache;
+    QCheckBox* m_fastSeek;
+    QComboBox* m_outputRate;
+    QComboBox* m_dspMode;
+    QComboBox* m_usfCore;
+    QComboBox* m_quality;
+    QLabel* m_renderSpeed;
 };
 } // namespace Fooyin::XSFInput